@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Measures the OIDN denoise time for every quality preset and several thread counts on a fixed test image.
+// The test image is generated procedurally (shaded spheres on a checkerboard with per-pixel noise from a fixed seed),
+// with matching albedo and normal images, so results are comparable between machines and runs.
+// The first call of each configuration creates the device and filter and is reported separately.
+// Usage: benchmark_denoise [width=1920] [height=1080] [iterations=5]
+
+import pragma.scenekit;
+
+namespace {
+	struct TestImage {
+		std::shared_ptr<uimg::ImageBuffer> beauty;
+		std::shared_ptr<uimg::ImageBuffer> albedo;
+		std::shared_ptr<uimg::ImageBuffer> normal;
+	};
+	TestImage create_test_image(uint32_t w, uint32_t h)
+	{
+		TestImage img {};
+		img.beauty = uimg::ImageBuffer::Create(w, h, uimg::Format::RGBA_FLOAT);
+		img.albedo = uimg::ImageBuffer::Create(w, h, uimg::Format::RGBA_FLOAT);
+		img.normal = uimg::ImageBuffer::Create(w, h, uimg::Format::RGBA_FLOAT);
+		auto *beauty = static_cast<float *>(img.beauty->GetData());
+		auto *albedo = static_cast<float *>(img.albedo->GetData());
+		auto *normal = static_cast<float *>(img.normal->GetData());
+		// mt19937 produces the same sequence on every platform, unlike the standard distributions
+		std::mt19937 rng {1'337};
+		auto rand01 = [&rng]() { return static_cast<float>(rng()) / static_cast<float>(std::mt19937::max()); };
+		constexpr std::array<std::array<float, 4>, 3> spheres {{{0.25f, 0.5f, 0.18f, 0.f}, {0.55f, 0.45f, 0.22f, 1.f}, {0.8f, 0.6f, 0.12f, 2.f}}}; // x, y, radius, color index
+		constexpr std::array<std::array<float, 3>, 3> sphereColors {{{0.8f, 0.2f, 0.2f}, {0.2f, 0.7f, 0.3f}, {0.3f, 0.4f, 0.9f}}};
+		auto aspect = static_cast<float>(w) / h;
+		for(uint32_t y = 0; y < h; ++y) {
+			for(uint32_t x = 0; x < w; ++x) {
+				auto u = (x + 0.5f) / w * aspect;
+				auto v = (y + 0.5f) / h;
+				std::array<float, 3> col = (((x / 32) + (y / 32)) % 2 == 0) ? std::array<float, 3> {0.9f, 0.9f, 0.9f} : std::array<float, 3> {0.2f, 0.2f, 0.2f};
+				std::array<float, 3> n {0.f, 1.f, 0.f};
+				auto shade = 0.4f + 0.6f * v;
+				for(auto &sphere : spheres) {
+					auto dx = (u - sphere[0] * aspect) / sphere[2];
+					auto dy = (v - sphere[1]) / sphere[2];
+					auto d2 = dx * dx + dy * dy;
+					if(d2 >= 1.f)
+						continue;
+					col = sphereColors[static_cast<size_t>(sphere[3])];
+					n = {dx, -dy, std::sqrt(1.f - d2)};
+					shade = std::max(0.f, n[0] * -0.4f + n[1] * 0.6f + n[2] * 0.7f) + 0.05f;
+				}
+				auto offset = (static_cast<size_t>(y) * w + x) * 4;
+				for(uint8_t c = 0; c < 3; ++c) {
+					albedo[offset + c] = col[c];
+					normal[offset + c] = n[c];
+					// Path tracer-like noise: Mostly dark samples with occasional bright fireflies
+					auto noise = rand01();
+					auto sample = (noise > 0.98f) ? 8.f : (noise * 2.f);
+					beauty[offset + c] = col[c] * shade * sample;
+				}
+				beauty[offset + 3] = 1.f;
+				albedo[offset + 3] = 1.f;
+				normal[offset + 3] = 1.f;
+			}
+		}
+		return img;
+	}
+	const char *get_quality_name(pragma::scenekit::denoise::Quality quality)
+	{
+		using pragma::scenekit::denoise::Quality;
+		switch(quality) {
+		case Quality::Fast:
+			return "Fast (AutoFast)";
+		case Quality::Balanced:
+			return "Balanced";
+		case Quality::High:
+			return "High (AutoDetailed)";
+		default:
+			return "Default";
+		}
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	using namespace pragma::scenekit;
+	uint32_t width = (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1])) : 1'920;
+	uint32_t height = (argc > 2) ? static_cast<uint32_t>(std::stoul(argv[2])) : 1'080;
+	uint32_t numIterations = (argc > 3) ? static_cast<uint32_t>(std::stoul(argv[3])) : 5;
+	if(width == 0 || height == 0 || numIterations == 0) {
+		std::cout << "Invalid arguments" << std::endl;
+		return 1;
+	}
+	auto testImage = create_test_image(width, height);
+	auto output = uimg::ImageBuffer::Create(width, height, uimg::Format::RGBA_FLOAT);
+
+	denoise::ImageInputs inputs {};
+	inputs.beautyImage = denoise::create_image_view(*testImage.beauty);
+	inputs.albedoImage = denoise::create_image_view(*testImage.albedo);
+	inputs.normalImage = denoise::create_image_view(*testImage.normal);
+	auto outputView = denoise::create_image_view(*output);
+
+	auto numHardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<uint32_t> threadCounts {0, 4, 16};
+	if(numHardwareThreads / 2 > 0)
+		threadCounts.push_back(numHardwareThreads / 2);
+	std::sort(threadCounts.begin(), threadCounts.end());
+	threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+	constexpr std::array<denoise::Quality, 4> qualities {denoise::Quality::Default, denoise::Quality::Fast, denoise::Quality::Balanced, denoise::Quality::High};
+
+	std::cout << "Image: " << width << "x" << height << ", hardware threads: " << numHardwareThreads << ", iterations: " << numIterations << std::endl;
+	auto &service = denoise::DenoiseService::GetInstance();
+	for(auto quality : qualities) {
+		for(auto numThreads : threadCounts) {
+			for(auto setAffinity : {false, true}) {
+				denoise::Info info {};
+				info.width = width;
+				info.height = height;
+				info.numThreads = numThreads;
+				info.setAffinity = setAffinity;
+				info.quality = quality;
+
+				auto t0 = std::chrono::steady_clock::now();
+				auto success = service.Denoise(info, inputs, outputView);
+				auto tFirst = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+				double tMin = std::numeric_limits<double>::max();
+				double tTotal = 0.0;
+				for(uint32_t i = 0; i < numIterations && success; ++i) {
+					t0 = std::chrono::steady_clock::now();
+					success = service.Denoise(info, inputs, outputView);
+					auto t = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+					tMin = std::min(tMin, t);
+					tTotal += t;
+				}
+				std::cout << get_quality_name(quality) << ", threads: " << ((numThreads == 0) ? std::string {"all"} : std::to_string(numThreads)) << ", affinity: " << setAffinity << " | ";
+				if(!success) {
+					std::cout << "failed" << std::endl;
+					continue;
+				}
+				std::cout << "first call: " << tFirst << " ms, mean: " << (tTotal / numIterations) << " ms, min: " << tMin << " ms" << std::endl;
+			}
+		}
+		// Keep the measurements of the next preset independent of the devices and filters of this one
+		service.Clear();
+	}
+	return 0;
+}
@@ -0,0 +1,110 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Measures the FinalizeImage render stage (Renderer::FinalizeResultImages) for a number of result passes, once with the
+// passes finalized serially and once in parallel. The color transform is applied if the OCIO config can be loaded
+// (modules/open_color_io/configs/ relative to the program), otherwise only the alpha channel is cleared.
+// Usage: benchmark_finalize_image [width=3840] [height=2160] [passes=12] [iterations=10] [config=filmic-blender]
+
+import pragma.scenekit;
+import pragma.ocio;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	uint32_t get_arg(int argc, char *argv[], int idx, uint32_t defaultValue) { return (idx < argc) ? static_cast<uint32_t>(std::stoul(argv[idx])) : defaultValue; }
+
+	// Only runs the FinalizeImage stage, nothing is rendered
+	class FinalizeBenchmarkRenderer : public pragma::scenekit::Renderer {
+	  public:
+		FinalizeBenchmarkRenderer(const pragma::scenekit::Scene &scene, const std::shared_ptr<pragma::ocio::ColorProcessor> &colorProcessor) : pragma::scenekit::Renderer {scene, Flags::None} { m_colorTransformProcessor = colorProcessor; }
+		using pragma::scenekit::Renderer::FinalizeResultImages;
+		using pragma::scenekit::Renderer::GetResultImageBuffer;
+		void SetParallel(bool parallel) { m_parallel = parallel; }
+
+		virtual void Wait() override {}
+		virtual void Start() override {}
+		virtual float GetProgress() const override { return 0.f; }
+		virtual void Reset() override {}
+		virtual void Restart() override {}
+		virtual bool Stop() override { return true; }
+		virtual bool Pause() override { return false; }
+		virtual bool Resume() override { return false; }
+		virtual bool Suspend() override { return false; }
+		virtual bool SyncEditedActor(const util::Uuid &uuid) override { return false; }
+		virtual bool AddLiveActor(pragma::scenekit::WorldObject &actor) override { return false; }
+		virtual bool Export(const std::string &path) override { return false; }
+		virtual std::optional<std::string> SaveRenderPreview(const std::string &path, std::string &outErr) const override { return {}; }
+		virtual util::ParallelJob<uimg::ImageLayerSet> StartRender() override { return {}; }
+	  protected:
+		virtual bool UpdateStereoEye(pragma::scenekit::RenderWorker &worker, pragma::scenekit::Renderer::ImageRenderStage stage, StereoEye &eyeStage) override { return false; }
+		virtual void SetCancelled(const std::string &msg) override {}
+		virtual void CloseRenderScene() override {}
+		// The base FinalizeImage doesn't do anything, so it's safe to call concurrently
+		virtual bool IsFinalizeImageThreadSafe() const override { return m_parallel; }
+	  private:
+		bool m_parallel = false;
+	};
+};
+
+int main(int argc, char *argv[])
+{
+	using namespace pragma::scenekit;
+	auto width = get_arg(argc, argv, 1, 3'840);
+	auto height = get_arg(argc, argv, 2, 2'160);
+	auto numPasses = get_arg(argc, argv, 3, 12);
+	auto numIterations = get_arg(argc, argv, 4, 10);
+	// A dozen AOVs, as they're commonly enabled together
+	constexpr std::array<PassType, 12> passTypes {PassType::Combined, PassType::Albedo, PassType::Emission, PassType::Diffuse, PassType::DiffuseDirect, PassType::DiffuseIndirect, PassType::Glossy, PassType::GlossyDirect, PassType::GlossyIndirect, PassType::Transmission,
+	  PassType::TransmissionDirect, PassType::TransmissionIndirect};
+	if(width == 0 || height == 0 || numPasses == 0 || numPasses > passTypes.size() || numIterations == 0) {
+		std::cout << "Invalid arguments" << std::endl;
+		return 1;
+	}
+
+	ColorTransformProcessorCreateInfo colorCreateInfo {};
+	if(argc > 5)
+		colorCreateInfo.config = argv[5];
+	std::string err;
+	auto colorProcessor = create_color_transform_processor(colorCreateInfo, err);
+	if(!colorProcessor)
+		std::cout << "Unable to create color transform processor, the color transform is skipped: " << err << std::endl;
+
+	auto nodeManager = NodeManager::Create();
+	auto scene = Scene::Create(*nodeManager, Scene::RenderMode::RenderImage);
+	auto renderer = std::make_shared<FinalizeBenchmarkRenderer>(*scene, colorProcessor);
+
+	// Every pass is reset to the same contents before each iteration
+	std::vector<float> sourceData(static_cast<size_t>(width) * height * 4);
+	for(size_t i = 0; i < sourceData.size(); ++i)
+		sourceData[i] = static_cast<float>(i % 4'093) / 1'024.f;
+	std::vector<uimg::ImageBuffer *> images;
+	images.reserve(numPasses);
+	for(uint32_t i = 0; i < numPasses; ++i)
+		images.push_back(renderer->GetResultImageBuffer(passTypes[i], width, height, uimg::Format::RGBA_FLOAT).get());
+	auto resetImages = [&]() {
+		for(auto *img : images)
+			std::memcpy(img->GetData(), sourceData.data(), sourceData.size() * sizeof(float));
+	};
+
+	std::cout << "Image: " << width << "x" << height << ", passes: " << numPasses << ", iterations: " << numIterations << ", color transform: " << (colorProcessor ? colorCreateInfo.config : std::string {"none"}) << std::endl;
+	std::array<double, 2> meanTimes {};
+	for(auto parallel : {false, true}) {
+		renderer->SetParallel(parallel);
+		resetImages();
+		renderer->FinalizeResultImages(Renderer::StereoEye::None); // Warm-up
+		double tMin = std::numeric_limits<double>::max();
+		double tTotal = 0.0;
+		for(uint32_t i = 0; i < numIterations; ++i) {
+			resetImages();
+			auto t0 = Clock::now();
+			renderer->FinalizeResultImages(Renderer::StereoEye::None);
+			auto t = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+			tMin = std::min(tMin, t);
+			tTotal += t;
+		}
+		meanTimes[parallel ? 1 : 0] = tTotal / numIterations;
+		std::cout << (parallel ? "Parallel" : "Serial") << ": mean: " << (tTotal / numIterations) << " ms, min: " << tMin << " ms" << std::endl;
+	}
+	std::cout << "Speed-up: " << (meanTimes[0] / meanTimes[1]) << "x" << std::endl;
+	return 0;
+}
@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Measures Renderer::FindObject and Renderer::FindRenderMeshByHash on a large synthetic model cache, compared against
+// the linear scan over all chunks that was used before the lookup tables. Also measures building the tables
+// (UpdateLookupTables) and adding live actors (AddToLookupTables).
+// Usage: benchmark_lookup [objects=100000] [objectsPerMesh=4] [objectsPerChunk=256] [queries=100000] [linearScanQueries=200]
+
+import pragma.scenekit;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	double to_ns_per_op(Clock::duration d, size_t numOps) { return (numOps > 0) ? std::chrono::duration<double, std::nano>(d).count() / numOps : 0.0; }
+	uint32_t get_arg(int argc, char *argv[], int idx, uint32_t defaultValue) { return (idx < argc) ? static_cast<uint32_t>(std::stoul(argv[idx])) : defaultValue; }
+
+	// Only exposes the lookup functions, nothing is rendered
+	class LookupBenchmarkRenderer : public pragma::scenekit::Renderer {
+	  public:
+		LookupBenchmarkRenderer(const pragma::scenekit::Scene &scene, const std::shared_ptr<pragma::scenekit::ModelCache> &modelCache) : pragma::scenekit::Renderer {scene, Flags::None} { m_renderData.modelCache = modelCache; }
+		using pragma::scenekit::Renderer::AddToLookupTables;
+		using pragma::scenekit::Renderer::FindObject;
+		using pragma::scenekit::Renderer::UpdateLookupTables;
+
+		pragma::scenekit::Object *FindObjectLinear(const std::string &objectName) const
+		{
+			for(auto &chunk : m_renderData.modelCache->GetChunks()) {
+				for(auto &obj : chunk.GetObjects()) {
+					if(obj->GetName() == objectName)
+						return obj.get();
+				}
+			}
+			return nullptr;
+		}
+		pragma::scenekit::PMesh FindRenderMeshByHashLinear(const util::MurmurHash3 &hash) const
+		{
+			for(auto &chunk : m_renderData.modelCache->GetChunks()) {
+				for(auto &mesh : chunk.GetMeshes()) {
+					if(mesh->GetHash() == hash)
+						return mesh;
+				}
+			}
+			return nullptr;
+		}
+
+		virtual void Wait() override {}
+		virtual void Start() override {}
+		virtual float GetProgress() const override { return 0.f; }
+		virtual void Reset() override {}
+		virtual void Restart() override {}
+		virtual bool Stop() override { return true; }
+		virtual bool Pause() override { return false; }
+		virtual bool Resume() override { return false; }
+		virtual bool Suspend() override { return false; }
+		virtual bool SyncEditedActor(const util::Uuid &uuid) override { return false; }
+		virtual bool AddLiveActor(pragma::scenekit::WorldObject &actor) override { return false; }
+		virtual bool Export(const std::string &path) override { return false; }
+		virtual std::optional<std::string> SaveRenderPreview(const std::string &path, std::string &outErr) const override { return {}; }
+		virtual util::ParallelJob<uimg::ImageLayerSet> StartRender() override { return {}; }
+	  protected:
+		virtual bool UpdateStereoEye(pragma::scenekit::RenderWorker &worker, pragma::scenekit::Renderer::ImageRenderStage stage, StereoEye &eyeStage) override { return false; }
+		virtual void SetCancelled(const std::string &msg) override {}
+		virtual void CloseRenderScene() override {}
+	};
+
+	util::MurmurHash3 create_hash(std::mt19937_64 &rng)
+	{
+		util::MurmurHash3 hash {};
+		for(auto &v : hash)
+			v = static_cast<std::remove_reference_t<decltype(v)>>(rng());
+		return hash;
+	}
+	std::string get_object_name(size_t idx) { return "object_" + std::to_string(idx); }
+};
+
+int main(int argc, char *argv[])
+{
+	using namespace pragma::scenekit;
+	auto numObjects = get_arg(argc, argv, 1, 100'000);
+	auto objectsPerMesh = get_arg(argc, argv, 2, 4);
+	auto objectsPerChunk = get_arg(argc, argv, 3, 256);
+	auto numQueries = get_arg(argc, argv, 4, 100'000);
+	auto numLinearQueries = get_arg(argc, argv, 5, 200);
+	if(numObjects == 0 || objectsPerMesh == 0 || objectsPerChunk == 0) {
+		std::cout << "Invalid arguments" << std::endl;
+		return 1;
+	}
+
+	std::mt19937_64 rng {1'337};
+	auto nodeManager = NodeManager::Create();
+	auto scene = Scene::Create(*nodeManager, Scene::RenderMode::RenderImage);
+	auto shaderCache = ShaderCache::Create();
+	auto modelCache = ModelCache::Create();
+	std::vector<util::MurmurHash3> meshHashes;
+	meshHashes.reserve(numObjects / objectsPerMesh + 1);
+	ModelCacheChunk *chunk = nullptr;
+	PMesh mesh = nullptr;
+	for(uint32_t i = 0; i < numObjects; ++i) {
+		if(i % objectsPerChunk == 0)
+			chunk = &modelCache->AddChunk(*shaderCache);
+		if(i % objectsPerMesh == 0 || i % objectsPerChunk == 0) {
+			mesh = Mesh::Create("mesh_" + std::to_string(meshHashes.size()), 3, 1);
+			mesh->SetHash(create_hash(rng));
+			meshHashes.push_back(mesh->GetHash());
+			chunk->AddMesh(*mesh);
+		}
+		auto obj = Object::Create(*mesh);
+		obj->SetName(get_object_name(i));
+		chunk->AddObject(*obj);
+	}
+	auto renderer = std::make_shared<LookupBenchmarkRenderer>(*scene, modelCache);
+
+	auto t0 = Clock::now();
+	renderer->UpdateLookupTables();
+	auto tBuild = Clock::now() - t0;
+
+	// Random queries, a quarter of them miss
+	std::vector<std::string> objectQueries;
+	std::vector<util::MurmurHash3> meshQueries;
+	objectQueries.reserve(numQueries);
+	meshQueries.reserve(numQueries);
+	for(uint32_t i = 0; i < numQueries; ++i) {
+		auto miss = (rng() % 4) == 0;
+		objectQueries.push_back(miss ? ("missing_" + std::to_string(i)) : get_object_name(rng() % numObjects));
+		meshQueries.push_back(miss ? create_hash(rng) : meshHashes[rng() % meshHashes.size()]);
+	}
+
+	size_t numFound = 0;
+	t0 = Clock::now();
+	for(auto &name : objectQueries)
+		numFound += (renderer->FindObject(name) != nullptr) ? 1 : 0;
+	auto tFindObject = Clock::now() - t0;
+	t0 = Clock::now();
+	for(auto &hash : meshQueries)
+		numFound += (renderer->FindRenderMeshByHash(hash) != nullptr) ? 1 : 0;
+	auto tFindMesh = Clock::now() - t0;
+
+	numLinearQueries = std::min(numLinearQueries, numQueries);
+	t0 = Clock::now();
+	for(uint32_t i = 0; i < numLinearQueries; ++i)
+		numFound += (renderer->FindObjectLinear(objectQueries[i]) != nullptr) ? 1 : 0;
+	auto tFindObjectLinear = Clock::now() - t0;
+	t0 = Clock::now();
+	for(uint32_t i = 0; i < numLinearQueries; ++i)
+		numFound += (renderer->FindRenderMeshByHashLinear(meshQueries[i]) != nullptr) ? 1 : 0;
+	auto tFindMeshLinear = Clock::now() - t0;
+
+	// Live actors, added to the tables one at a time
+	constexpr uint32_t numLiveActors = 1'000;
+	std::vector<PObject> liveActors;
+	liveActors.reserve(numLiveActors);
+	for(uint32_t i = 0; i < numLiveActors; ++i) {
+		auto liveMesh = Mesh::Create("live_mesh_" + std::to_string(i), 3, 1);
+		liveMesh->SetHash(create_hash(rng));
+		auto obj = Object::Create(*liveMesh);
+		obj->SetName("live_" + std::to_string(i));
+		liveActors.push_back(obj);
+	}
+	t0 = Clock::now();
+	for(auto &obj : liveActors)
+		renderer->AddToLookupTables(*obj);
+	auto tAdd = Clock::now() - t0;
+
+	std::cout << "Objects: " << numObjects << ", meshes: " << meshHashes.size() << ", chunks: " << modelCache->GetChunks().size() << ", queries: " << numQueries << " (linear scan: " << numLinearQueries << ")" << std::endl;
+	std::cout << "UpdateLookupTables: " << std::chrono::duration<double, std::milli>(tBuild).count() << " ms" << std::endl;
+	std::cout << "FindObject: " << to_ns_per_op(tFindObject, numQueries) << " ns/lookup, linear scan: " << to_ns_per_op(tFindObjectLinear, numLinearQueries) << " ns/lookup" << std::endl;
+	std::cout << "FindRenderMeshByHash: " << to_ns_per_op(tFindMesh, numQueries) << " ns/lookup, linear scan: " << to_ns_per_op(tFindMeshLinear, numLinearQueries) << " ns/lookup" << std::endl;
+	std::cout << "AddToLookupTables: " << to_ns_per_op(tAdd, numLiveActors) << " ns/actor" << std::endl;
+	std::cout << "(" << numFound << " lookups succeeded)" << std::endl;
+	return 0;
+}
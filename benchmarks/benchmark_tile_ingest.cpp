@@ -0,0 +1,83 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Compares the fused tile ingest kernel (image_kernels::ingest_tile) against the previous path of
+// TileManager::InitializeTileData, which wrapped the tile in an ImageBuffer and ran Flip and ClearAlpha separately.
+// The OCIO color transform is applied the same way on both paths and is therefore not part of the comparison.
+// Usage: benchmark_tile_ingest [iterations=2000]
+
+import pragma.scenekit;
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	template<typename TFunc>
+	double measure_ns_per_tile(uint32_t numIterations, const TFunc &func)
+	{
+		func(); // Warm-up
+		auto t0 = Clock::now();
+		for(uint32_t i = 0; i < numIterations; ++i)
+			func();
+		auto t1 = Clock::now();
+		return std::chrono::duration<double, std::nano>(t1 - t0).count() / numIterations;
+	}
+	void ingest_image_buffer(float *data, uint32_t w, uint32_t h, bool flipHorizontally, bool flipVertically)
+	{
+		auto img = uimg::ImageBuffer::Create(data, w, h, uimg::Format::RGBA_FLOAT);
+		img->Flip(flipHorizontally, flipVertically);
+		img->ClearAlpha(uimg::ImageBuffer::FULLY_OPAQUE);
+	}
+	void ingest_fused(float *data, uint32_t w, uint32_t h, bool flipHorizontally, bool flipVertically)
+	{
+		pragma::scenekit::image_kernels::TileIngestInfo info {};
+		info.width = w;
+		info.height = h;
+		info.flipHorizontally = flipHorizontally;
+		info.flipVertically = flipVertically;
+		pragma::scenekit::image_kernels::ingest_tile(data, data, info);
+	}
+	void fill_tile(std::vector<float> &data)
+	{
+		for(size_t i = 0; i < data.size(); ++i)
+			data[i] = static_cast<float>(i % 1'021) / 1'021.f;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	uint32_t numIterations = (argc > 1) ? static_cast<uint32_t>(std::stoul(argv[1])) : 2'000;
+	if(numIterations == 0) {
+		std::cout << "Invalid arguments" << std::endl;
+		return 1;
+	}
+	constexpr std::array<uint32_t, 5> tileSizes {16, 32, 64, 128, 256};
+	constexpr std::array<std::pair<bool, bool>, 4> flipModes {{{false, false}, {true, false}, {false, true}, {true, true}}};
+
+	std::vector<float> dataA;
+	std::vector<float> dataB;
+	auto mismatch = false;
+	for(auto tileSize : tileSizes) {
+		auto numValues = static_cast<size_t>(tileSize) * tileSize * 4;
+		dataA.resize(numValues);
+		dataB.resize(numValues);
+		for(auto [flipH, flipV] : flipModes) {
+			// Both paths have to produce the same result
+			fill_tile(dataA);
+			fill_tile(dataB);
+			ingest_image_buffer(dataA.data(), tileSize, tileSize, flipH, flipV);
+			ingest_fused(dataB.data(), tileSize, tileSize, flipH, flipV);
+			if(dataA != dataB) {
+				std::cout << "Result mismatch for tile size " << tileSize << " (flip h: " << flipH << ", flip v: " << flipV << ")" << std::endl;
+				mismatch = true;
+			}
+
+			// Both paths run in place, so repeated runs keep flipping the same tile back and forth
+			auto tImageBuffer = measure_ns_per_tile(numIterations, [&]() { ingest_image_buffer(dataA.data(), tileSize, tileSize, flipH, flipV); });
+			auto tFused = measure_ns_per_tile(numIterations, [&]() { ingest_fused(dataB.data(), tileSize, tileSize, flipH, flipV); });
+			auto bytes = static_cast<double>(numValues * sizeof(float));
+			std::cout << tileSize << "x" << tileSize << " flip h: " << flipH << " flip v: " << flipV << " | Flip+ClearAlpha: " << (tImageBuffer / 1'000.0) << " us (" << (bytes / tImageBuffer) << " GB/s)"
+			          << " | fused: " << (tFused / 1'000.0) << " us (" << (bytes / tFused) << " GB/s)"
+			          << " | speed-up: " << (tImageBuffer / tFused) << "x" << std::endl;
+		}
+	}
+	return mismatch ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+// Measures the time from a tile arriving at the TileManager (CommitInputTile) to it being returned by PollRenderedTiles.
+// A producer thread commits every tile for a number of samples while a consumer thread polls continuously, so the
+// result is dominated by the post-processing pipeline rather than by the consumer.
+// Usage: benchmark_tile_latency [width=1920] [height=1080] [tileSize=64] [samples=64] [sampleIntervalUs=0]
+
+import pragma.scenekit;
+
+namespace {
+	uint32_t get_arg(int argc, char *argv[], int idx, uint32_t defaultValue) { return (idx < argc) ? static_cast<uint32_t>(std::stoul(argv[idx])) : defaultValue; }
+	uint64_t get_percentile(const std::vector<uint64_t> &sortedValues, double percentile)
+	{
+		if(sortedValues.empty())
+			return 0;
+		auto idx = static_cast<size_t>(std::ceil(percentile * sortedValues.size()));
+		return sortedValues[std::clamp<size_t>(idx, 1, sortedValues.size()) - 1];
+	}
+	double to_us(uint64_t ns) { return ns / 1'000.0; }
+};
+
+int main(int argc, char *argv[])
+{
+	using namespace pragma::scenekit;
+	auto width = get_arg(argc, argv, 1, 1'920);
+	auto height = get_arg(argc, argv, 2, 1'080);
+	auto tileSize = get_arg(argc, argv, 3, 64);
+	auto numSamples = get_arg(argc, argv, 4, 64);
+	auto sampleInterval = std::chrono::microseconds {get_arg(argc, argv, 5, 0)};
+	if(width == 0 || height == 0 || tileSize == 0 || numSamples == 0 || numSamples >= std::numeric_limits<uint16_t>::max()) {
+		std::cout << "Invalid arguments" << std::endl;
+		return 1;
+	}
+
+	TileManager tileManager {};
+	tileManager.SetInstrumentationEnabled(true);
+	tileManager.Initialize(width, height, tileSize, tileSize, true);
+	auto numTilesPerAxis = tileManager.GetTilesPerAxisCount();
+	auto numTiles = tileManager.GetTileCount();
+	if(numTiles > std::numeric_limits<uint16_t>::max()) {
+		std::cout << "Too many tiles, use a larger tile size" << std::endl;
+		return 1;
+	}
+
+	// Arrival timestamp of every sample of every tile
+	std::vector<std::atomic<uint64_t>> arrivalTimes(static_cast<size_t>(numTiles) * numSamples);
+	std::vector<uint64_t> latencies;
+	latencies.reserve(arrivalTimes.size());
+	auto consumeTiles = [&]() {
+		auto &tiles = tileManager.PollRenderedTiles();
+		if(tiles.empty())
+			return;
+		auto t = LatencyHistogram::GetTimestamp();
+		for(auto &tile : tiles) {
+			if(tile.index >= numTiles || tile.sample >= numSamples)
+				continue;
+			auto arrival = arrivalTimes[static_cast<size_t>(tile.index) * numSamples + tile.sample].load(std::memory_order_acquire);
+			if(arrival != 0 && t > arrival)
+				latencies.push_back(t - arrival);
+		}
+	};
+
+	std::atomic<bool> producerDone = false;
+	std::thread consumer {[&]() {
+		while(!producerDone.load(std::memory_order_acquire)) {
+			consumeTiles();
+			std::this_thread::yield();
+		}
+	}};
+
+	auto tStart = std::chrono::steady_clock::now();
+	for(uint32_t sample = 0; sample < numSamples; ++sample) {
+		for(uint32_t i = 0; i < numTiles; ++i) {
+			auto x = (i % numTilesPerAxis.x) * tileSize;
+			auto y = (i / numTilesPerAxis.x) * tileSize;
+			auto w = std::min(tileSize, width - x);
+			auto h = std::min(tileSize, height - y);
+			auto lease = tileManager.LeaseInputTile(i, x, y, w, h, sample);
+			if(!lease.IsValid())
+				continue;
+			auto *data = reinterpret_cast<float *>(lease.GetData());
+			auto numValues = static_cast<size_t>(w) * h * 4;
+			for(size_t j = 0; j < numValues; ++j)
+				data[j] = static_cast<float>((j + sample) % 256) / 255.f;
+			arrivalTimes[static_cast<size_t>(i) * numSamples + sample].store(LatencyHistogram::GetTimestamp(), std::memory_order_release);
+			tileManager.CommitInputTile(std::move(lease));
+		}
+		if(sampleInterval.count() > 0)
+			std::this_thread::sleep_for(sampleInterval);
+	}
+	// Process all remaining tiles before the last poll
+	tileManager.StopAndWait();
+	producerDone = true;
+	consumer.join();
+	consumeTiles();
+	auto tEnd = std::chrono::steady_clock::now();
+
+	std::sort(latencies.begin(), latencies.end());
+	auto stats = tileManager.GetRenderedTileStats();
+	std::cout << "Image: " << width << "x" << height << ", tile size: " << tileSize << ", tiles: " << numTiles << ", samples: " << numSamples << std::endl;
+	std::cout << "Total time: " << std::chrono::duration<double, std::milli>(tEnd - tStart).count() << " ms" << std::endl;
+	std::cout << "Tiles published: " << stats.numPublished << ", coalesced: " << stats.numCoalesced << ", dropped: " << stats.numDropped << ", consumed: " << latencies.size() << std::endl;
+	std::cout << "Arrival to consumer (us): p50 = " << to_us(get_percentile(latencies, 0.5)) << ", p99 = " << to_us(get_percentile(latencies, 0.99)) << ", max = " << to_us(latencies.empty() ? 0 : latencies.back()) << std::endl;
+
+	// Per-stage breakdown, the consumer delay has to be subtracted to get the time to publication.
+	// The histogram percentiles are bucket upper bounds (powers of two).
+	constexpr std::pair<TileManager::PipelineStage, const char *> stages[] = {
+	  {TileManager::PipelineStage::QueueWait, "QueueWait"},
+	  {TileManager::PipelineStage::Ingest, "Ingest"},
+	  {TileManager::PipelineStage::ColorTransform, "ColorTransform"},
+	  {TileManager::PipelineStage::CompletedTileLockWait, "CompletedTileLockWait"},
+	  {TileManager::PipelineStage::RenderedTileLockWait, "RenderedTileLockWait"},
+	  {TileManager::PipelineStage::ConsumerDelay, "ConsumerDelay"},
+	};
+	for(auto &[stage, name] : stages) {
+		auto &hist = tileManager.GetStageLatency(stage);
+		std::cout << name << " (us): mean = " << to_us(static_cast<uint64_t>(hist.GetMean())) << ", p50 <= " << to_us(hist.GetPercentile(0.5)) << ", p99 <= " << to_us(hist.GetPercentile(0.99)) << ", max = " << to_us(hist.GetMax())
+		          << std::endl;
+	}
+	return 0;
+}
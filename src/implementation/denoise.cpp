@@ -8,6 +8,7 @@ module;
 module pragma.scenekit;
 
 import :denoise;
+import :image_kernels;
 
 static std::optional<oidn::Format> get_oidn_format(uimg::Format format)
 {
@@ -15,7 +16,7 @@ static std::optional<oidn::Format> get_oidn_format(uimg::Format format)
 	case uimg::Format::R32:
 	case uimg::Format::RG32:
 	case uimg::Format::RGB32:
-	case uimg::Format::RGBA32:
+	case uimg::Format::RGBA32: // Alpha is skipped through the pixel stride
 		return oidn::Format::Float3;
 	case uimg::Format::R16:
 	case uimg::Format::RG16:
@@ -26,51 +27,106 @@ static std::optional<oidn::Format> get_oidn_format(uimg::Format format)
 	return {};
 }
 
-pragma::scenekit::denoise::Denoiser::Denoiser()
+uint32_t pragma::scenekit::denoise::ImageData::GetPixelStride() const { return (pixelStride > 0) ? pixelStride : uimg::ImageBuffer::GetPixelSize(format); }
+uint32_t pragma::scenekit::denoise::ImageData::GetRowStride(uint32_t width) const { return (rowStride > 0) ? rowStride : (width * GetPixelStride()); }
+uint8_t *pragma::scenekit::denoise::ImageData::GetPixel(uint32_t width, uint32_t x, uint32_t y) const { return data + static_cast<size_t>(y) * GetRowStride(width) + static_cast<size_t>(x) * GetPixelStride(); }
+pragma::scenekit::denoise::ImageData pragma::scenekit::denoise::ImageData::GetSubView(uint32_t width, uint32_t x, uint32_t y) const
+{
+	if(!data)
+		return {};
+	auto view = *this;
+	view.data = GetPixel(width, x, y);
+	// The row stride of the view has to be explicit, since the view is narrower than the image
+	view.pixelStride = GetPixelStride();
+	view.rowStride = GetRowStride(width);
+	return view;
+}
+
+pragma::scenekit::denoise::ImageData pragma::scenekit::denoise::create_image_view(uimg::ImageBuffer &imgBuffer, uint32_t x, uint32_t y)
+{
+	ImageData view {static_cast<uint8_t *>(imgBuffer.GetData()), imgBuffer.GetFormat()};
+	if(x == 0 && y == 0)
+		return view;
+	return view.GetSubView(imgBuffer.GetWidth(), x, y);
+}
+
+static void set_filter_image(oidn::FilterRef &filter, const char *name, const pragma::scenekit::denoise::Info &denoise, const pragma::scenekit::denoise::ImageData &img, oidn::Format format)
+{
+	filter.setImage(name, img.data, format, denoise.width, denoise.height, 0u, img.GetPixelStride(), img.GetRowStride(denoise.width));
+}
+
+static std::shared_ptr<oidn::DeviceRef> create_device(uint32_t numThreads, bool setAffinity)
 {
 	auto device = oidn::newDevice();
 	const char *errMsg;
-	if(device.getError(errMsg) != oidn::Error::None)
-		return;
+	if(device.getError(errMsg) != oidn::Error::None) {
+		std::cout << "Failed to create denoising device: " << errMsg << std::endl;
+		return nullptr;
+	}
 	/*device.setErrorFunction([](void *userPtr,oidn::Error code,const char *message) {
 		std::cout<<"Error: "<<message<<std::endl;
 		});
 	device.set("verbose",true);*/
+	// Without a limit OIDN would occupy all hardware threads, which starves the render and tile threads.
+	// These parameters only apply to CPU devices and are ignored by other device types.
+	device.set("numThreads", static_cast<int>(numThreads));
+	device.set("setAffinity", setAffinity);
 	device.commit();
-	m_device = std::make_unique<oidn::DeviceRef>(device);
+	return std::make_shared<oidn::DeviceRef>(device);
 }
 
-bool pragma::scenekit::denoise::Denoiser::Denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+static bool set_filter_images(oidn::FilterRef &filter, const pragma::scenekit::denoise::Info &denoise, const pragma::scenekit::denoise::ImageInputs &inputImages, const pragma::scenekit::denoise::ImageData &outputImage)
 {
-	if(m_device == nullptr)
-		return false;
-	oidn::FilterRef filter = m_device->newFilter(denoise.lightmap ? "RTLightmap" : "RT");
-
 	auto beautyFormat = get_oidn_format(inputImages.beautyImage.format);
 	if(!beautyFormat)
 		return false;
-	filter.setImage("color", inputImages.beautyImage.data, *beautyFormat, denoise.width, denoise.height, 0u, uimg::ImageBuffer::GetPixelSize(inputImages.beautyImage.format));
+	set_filter_image(filter, "color", denoise, inputImages.beautyImage, *beautyFormat);
 	if(denoise.lightmap == false) {
 		if(inputImages.albedoImage.data) {
 			auto albedoFormat = get_oidn_format(inputImages.albedoImage.format);
 			if(!albedoFormat)
 				return false;
-			filter.setImage("albedo", inputImages.albedoImage.data, *albedoFormat, denoise.width, denoise.height, 0u, uimg::ImageBuffer::GetPixelSize(inputImages.albedoImage.format));
+			set_filter_image(filter, "albedo", denoise, inputImages.albedoImage, *albedoFormat);
 		}
 		if(inputImages.normalImage.data) {
 			auto normalFormat = get_oidn_format(inputImages.normalImage.format);
 			if(!normalFormat)
 				return false;
-			filter.setImage("normal", inputImages.normalImage.data, *normalFormat, denoise.width, denoise.height, 0u, uimg::ImageBuffer::GetPixelSize(inputImages.normalImage.format));
+			set_filter_image(filter, "normal", denoise, inputImages.normalImage, *normalFormat);
 		}
 
 		filter.set("hdr", denoise.hdr);
 	}
+	if(denoise.maxMemoryMB > 0)
+		filter.set("maxMemoryMB", static_cast<int>(denoise.maxMemoryMB));
+#if defined(OIDN_VERSION_MAJOR) && OIDN_VERSION_MAJOR >= 2
+	switch(denoise.quality) {
+	case pragma::scenekit::denoise::Quality::Fast:
+#if OIDN_VERSION >= 20200
+		filter.set("quality", oidn::Quality::Fast);
+#else
+		filter.set("quality", oidn::Quality::Balanced);
+#endif
+		break;
+	case pragma::scenekit::denoise::Quality::Balanced:
+		filter.set("quality", oidn::Quality::Balanced);
+		break;
+	case pragma::scenekit::denoise::Quality::High:
+		filter.set("quality", oidn::Quality::High);
+		break;
+	default:
+		break;
+	}
+#endif
 	auto outputFormat = get_oidn_format(outputImage.format);
 	if(!outputFormat)
 		return false;
-	filter.setImage("output", outputImage.data, *outputFormat, denoise.width, denoise.height, 0u, uimg::ImageBuffer::GetPixelSize(outputImage.format));
+	set_filter_image(filter, "output", denoise, outputImage, *outputFormat);
+	return true;
+}
 
+static bool execute_filter(oidn::DeviceRef &device, oidn::FilterRef &filter, const std::function<bool(float)> &fProgressCallback)
+{
 	std::unique_ptr<std::function<bool(float)>> ptrProgressCallback = nullptr;
 	if(fProgressCallback) {
 		ptrProgressCallback = std::make_unique<std::function<bool(float)>>(fProgressCallback);
@@ -83,45 +139,487 @@ bool pragma::scenekit::denoise::Denoiser::Denoise(const Info &denoise, const Ima
 		  },
 		  ptrProgressCallback.get());
 	}
+	else
+		filter.setProgressMonitorFunction(nullptr); // Filter may have been used with a callback before
 
 	filter.commit();
 
 	filter.execute();
 
+	if(ptrProgressCallback)
+		filter.setProgressMonitorFunction(nullptr); // The callback doesn't outlive this call
+
 	const char *errorMessage;
-	if(m_device->getError(errorMessage) != oidn::Error::None) {
+	if(device.getError(errorMessage) != oidn::Error::None) {
 		std::cout << "Denoising failed: " << errorMessage << std::endl;
 		return false;
 	}
+	return true;
+}
 
+// Rough estimate of the denoiser working set per pixel, used to derive the tile size from the memory limit
+constexpr uint32_t DENOISE_BYTES_PER_PIXEL = 512;
+
+static bool is_cpu_device(oidn::DeviceRef &device)
+{
+#if defined(OIDN_VERSION_MAJOR) && OIDN_VERSION_MAJOR >= 2
+	return static_cast<oidn::DeviceType>(device.get<int>("type")) == oidn::DeviceType::CPU;
+#else
 	return true;
+#endif
 }
 
-bool pragma::scenekit::denoise::denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+// Number of accumulation bands (one per tile row) that can be in flight while tiles are being denoised, see denoise_tiled
+constexpr uint32_t DENOISE_MAX_ACCUMULATION_BANDS = 4;
+
+static uint32_t get_denoise_tile_size(const pragma::scenekit::denoise::Info &denoise, uint32_t numParallelTiles)
 {
-	Denoiser denoiser {};
-	return denoiser.Denoise(denoise, inputImages, outputImage, fProgressCallback);
+	auto tileSize = denoise.tileSize;
+	if(denoise.maxMemoryMB > 0) {
+		auto maxBytes = static_cast<uint64_t>(denoise.maxMemoryMB) * 1'024 * 1'024;
+		auto maxPixels = maxBytes / DENOISE_BYTES_PER_PIXEL / numParallelTiles;
+		if(static_cast<uint64_t>(denoise.width) * denoise.height > maxPixels) {
+			// Largest square tile that stays within the limit, including the overlap
+			auto maxTileSize = static_cast<uint32_t>(std::sqrt(static_cast<double>(maxPixels)));
+			maxTileSize = (maxTileSize > denoise.tileOverlap * 4) ? (maxTileSize - denoise.tileOverlap * 2) : (denoise.tileOverlap * 2);
+			// The accumulation bands of the tile rows in flight count against the limit as well
+			auto getRequiredMemory = [&denoise, numParallelTiles](uint64_t tileSize) {
+				auto paddedSize = tileSize + denoise.tileOverlap * 2;
+				return paddedSize * paddedSize * DENOISE_BYTES_PER_PIXEL * numParallelTiles + DENOISE_MAX_ACCUMULATION_BANDS * tileSize * denoise.width * sizeof(float) * 3;
+			};
+			while(maxTileSize > 16 && getRequiredMemory(maxTileSize) > maxBytes)
+				maxTileSize = umath::max(maxTileSize - 16, 16u);
+			tileSize = (tileSize > 0) ? umath::min(tileSize, maxTileSize) : maxTileSize;
+		}
+	}
+	if(tileSize == 0 || (tileSize >= denoise.width && tileSize >= denoise.height))
+		return 0;
+	return umath::max(tileSize, 16u);
 }
 
-bool pragma::scenekit::denoise::denoise(const Info &denoiseInfo, uimg::ImageBuffer &imgBuffer, uimg::ImageBuffer *optImgBufferAlbedo, uimg::ImageBuffer *optImgBufferNormal, const std::function<bool(float)> &fProgressCallback)
+// Weight of a tile with the core [c0,c1) at the pixel center x. The weights of neighboring tiles ramp linearly across
+// a band of 2 * halfBand pixels centered on the seam and always sum up to 1.
+static float get_tile_blend_weight(float x, uint32_t c0, uint32_t c1, uint32_t size, float halfBand)
 {
-	Denoiser denoiser {};
-	ImageInputs inputs {};
-	inputs.beautyImage.data = static_cast<uint8_t *>(imgBuffer.GetData());
-	inputs.beautyImage.format = imgBuffer.GetFormat();
+	if(halfBand <= 0.f)
+		return (x >= c0 && x < c1) ? 1.f : 0.f;
+	auto w = 1.f;
+	if(c0 > 0)
+		w *= std::clamp((x - (c0 - halfBand)) / (2.f * halfBand), 0.f, 1.f);
+	if(c1 < size)
+		w *= std::clamp(((c1 + halfBand) - x) / (2.f * halfBand), 0.f, 1.f);
+	return w;
+}
+
+// Start of the padded input extent of a tile with the core starting at c0. Tiles at the image border are shifted
+// inwards instead of being cropped, so every tile has the same padded size.
+static uint32_t get_tile_extent_start(uint32_t c0, uint32_t overlap, uint32_t paddedSize, uint32_t size)
+{
+	auto start = (c0 > overlap) ? (c0 - overlap) : 0;
+	return umath::min(start, size - paddedSize);
+}
+
+using DenoiseTileFunction = std::function<bool(const pragma::scenekit::denoise::Info &, const pragma::scenekit::denoise::ImageInputs &, const pragma::scenekit::denoise::ImageData &, const std::function<bool(float)> &)>;
+static bool denoise_tiled(const pragma::scenekit::denoise::Info &denoise, const pragma::scenekit::denoise::ImageInputs &inputImages, const pragma::scenekit::denoise::ImageData &outputImage, uint32_t tileSize, uint32_t numParallelTiles, const DenoiseTileFunction &denoiseTile,
+  const std::function<bool(float)> &fProgressCallback)
+{
+	using namespace pragma::scenekit::denoise;
+	auto width = denoise.width;
+	auto height = denoise.height;
+	auto overlap = umath::min(denoise.tileOverlap, tileSize);
+	auto halfBand = overlap * 0.5f;
+	auto numTilesX = (width + tileSize - 1) / tileSize;
+	auto numTilesY = (height + tileSize - 1) / tileSize;
+	auto numTiles = numTilesX * numTilesY;
+	// All tiles have the same padded size, so they can share the same cached filter
+	auto w = umath::min(tileSize + overlap * 2, width);
+	auto h = umath::min(tileSize + overlap * 2, height);
+
+	// Reference result for verifyTiling, has to be denoised before the output is written, since it may alias the inputs
+	std::vector<float> reference;
+	if(denoise.verifyTiling) {
+		auto referenceInfo = denoise;
+		referenceInfo.tileSize = 0;
+		referenceInfo.maxMemoryMB = 0;
+		reference.resize(static_cast<size_t>(width) * height * 3);
+		if(!denoiseTile(referenceInfo, inputImages, {reinterpret_cast<uint8_t *>(reference.data()), uimg::Format::RGB32}, nullptr)) {
+			std::cout << "[Denoiser] Unable to verify tiled denoising: Full frame denoising failed!" << std::endl;
+			reference.clear();
+		}
+	}
+	float maxDeviation = 0.f;
+
+	// The output may alias the inputs, so the blended result is accumulated separately. Every tile row has its own band
+	// covering the core rows of its tiles. Tiles only contribute to the bands of their own and the neighboring tile rows.
+	// A band is written to the output (and released) once those rows are complete and the input extent of no pending tile
+	// row overlaps it anymore. Border rows are shifted inwards, so their extent may reach further than the neighboring band.
+	struct Band {
+		std::vector<float> data;
+		bool written = false;
+	};
+	std::vector<Band> bands(numTilesY);
+	std::vector<uint32_t> numCompletedTilesPerRow(numTilesY, 0);
+	auto getBandHeight = [&](uint32_t band) { return umath::min((band + 1) * tileSize, height) - band * tileSize; };
+	auto isRowComplete = [&](int64_t row) { return row < 0 || row >= numTilesY || numCompletedTilesPerRow[row] == numTilesX; };
+	auto canWriteBand = [&](uint32_t band) {
+		if(bands[band].written || !isRowComplete(static_cast<int64_t>(band) - 1) || !isRowComplete(band) || !isRowComplete(static_cast<int64_t>(band) + 1))
+			return false;
+		auto y0 = band * tileSize;
+		auto y1 = y0 + getBandHeight(band);
+		for(auto row = decltype(numTilesY) {0u}; row < numTilesY; ++row) {
+			if(isRowComplete(row))
+				continue;
+			auto ey0 = get_tile_extent_start(row * tileSize, overlap, h, height);
+			if(ey0 < y1 && ey0 + h > y0)
+				return false; // Still has to read the input rows of this band
+		}
+		return true;
+	};
+
+	auto pixelSize = uimg::ImageBuffer::GetPixelSize(outputImage.format);
+	auto isHalf = (get_oidn_format(outputImage.format) == oidn::Format::Half3);
+	auto channelSize = isHalf ? sizeof(uint16_t) : sizeof(float);
+	auto numChannels = umath::min<size_t>(pixelSize / channelSize, 3);
+	auto writeBand = [&](uint32_t band, const std::vector<float> &data) {
+		// Formats with fewer than three channels only receive the channels they have
+		auto y0 = band * tileSize;
+		auto bandHeight = getBandHeight(band);
+		auto pixelStride = outputImage.GetPixelStride();
+		for(auto y = decltype(bandHeight) {0u}; y < bandHeight; ++y) {
+			auto *dstRow = outputImage.GetPixel(width, 0, y0 + y);
+			for(auto x = decltype(width) {0u}; x < width; ++x) {
+				auto *src = data.data() + (static_cast<size_t>(y) * width + x) * 3;
+				auto *dst = dstRow + static_cast<size_t>(x) * pixelStride;
+				if(isHalf)
+					pragma::scenekit::image_kernels::convert_f32_to_f16(src, reinterpret_cast<uint16_t *>(dst), numChannels);
+				else
+					std::memcpy(dst, src, numChannels * sizeof(float));
+			}
+		}
+		if(reference.empty())
+			return;
+		auto bandMaxDeviation = 0.f;
+		auto *ref = reference.data() + static_cast<size_t>(y0) * width * 3;
+		for(size_t i = 0; i < static_cast<size_t>(bandHeight) * width * 3; ++i)
+			bandMaxDeviation = umath::max(bandMaxDeviation, std::abs(data[i] - ref[i]) / umath::max(std::abs(ref[i]), 1.f));
+		maxDeviation = umath::max(maxDeviation, bandMaxDeviation); // Bands are written one at a time
+	};
+
+	std::mutex accumulationMutex;
+	std::mutex outputMutex;
+	std::mutex progressMutex;
+	std::vector<float> tileProgress(numTiles, 0.f);
+	std::atomic<bool> cancelled = false;
+	std::atomic<bool> failed = false;
+	std::atomic<uint32_t> nextTile = 0;
+
+	auto processTiles = [&]() {
+		std::vector<uint8_t> beautyData;
+		std::vector<uint8_t> albedoData;
+		std::vector<uint8_t> normalData;
+		std::vector<float> outputData;
+		std::vector<std::pair<uint32_t, std::vector<float>>> completedBands;
+		for(auto tileIdx = nextTile++; tileIdx < numTiles && !cancelled && !failed; tileIdx = nextTile++) {
+			auto tileX = tileIdx % numTilesX;
+			auto tileY = tileIdx / numTilesX;
+			auto cx0 = tileX * tileSize;
+			auto cy0 = tileY * tileSize;
+			auto cx1 = umath::min(cx0 + tileSize, width);
+			auto cy1 = umath::min(cy0 + tileSize, height);
+			// Input extent of the tile including the context
+			auto ex0 = get_tile_extent_start(cx0, overlap, w, width);
+			auto ey0 = get_tile_extent_start(cy0, overlap, h, height);
+			auto ex1 = ex0 + w;
+			auto ey1 = ey0 + h;
+
+			auto copyRegion = [&](const ImageData &src, std::vector<uint8_t> &dst) -> ImageData {
+				if(!src.data)
+					return {};
+				// The tile copies are always tightly packed
+				auto pixelSize = uimg::ImageBuffer::GetPixelSize(src.format);
+				auto pixelStride = src.GetPixelStride();
+				dst.resize(static_cast<size_t>(w) * h * pixelSize);
+				for(auto y = decltype(h) {0u}; y < h; ++y) {
+					auto *srcRow = src.GetPixel(width, ex0, ey0 + y);
+					auto *dstRow = dst.data() + static_cast<size_t>(y) * w * pixelSize;
+					if(pixelStride == pixelSize) {
+						std::memcpy(dstRow, srcRow, static_cast<size_t>(w) * pixelSize);
+						continue;
+					}
+					for(auto x = decltype(w) {0u}; x < w; ++x)
+						std::memcpy(dstRow + static_cast<size_t>(x) * pixelSize, srcRow + static_cast<size_t>(x) * pixelStride, pixelSize);
+				}
+				return {dst.data(), src.format};
+			};
+			ImageInputs tileInputs {};
+			tileInputs.beautyImage = copyRegion(inputImages.beautyImage, beautyData);
+			tileInputs.albedoImage = copyRegion(inputImages.albedoImage, albedoData);
+			tileInputs.normalImage = copyRegion(inputImages.normalImage, normalData);
+			outputData.resize(static_cast<size_t>(w) * h * 3);
+			ImageData tileOutput {reinterpret_cast<uint8_t *>(outputData.data()), uimg::Format::RGB32};
+
+			auto tileInfo = denoise;
+			tileInfo.width = w;
+			tileInfo.height = h;
+			tileInfo.tileSize = 0;
+			tileInfo.maxMemoryMB = denoise.maxMemoryMB / numParallelTiles;
+			auto result = denoiseTile(tileInfo, tileInputs, tileOutput, [&](float progress) -> bool {
+				if(cancelled)
+					return false;
+				if(!fProgressCallback)
+					return true;
+				std::scoped_lock lock {progressMutex};
+				tileProgress[tileIdx] = progress;
+				auto totalProgress = std::accumulate(tileProgress.begin(), tileProgress.end(), 0.f) / numTiles;
+				if(!fProgressCallback(totalProgress))
+					cancelled = true;
+				return !cancelled;
+			});
+			if(!result) {
+				failed = true;
+				break;
+			}
+
+			std::unique_lock lock {accumulationMutex};
+			for(auto y = ey0; y < ey1; ++y) {
+				auto wy = get_tile_blend_weight(y + 0.5f, cy0, cy1, height, halfBand);
+				if(wy <= 0.f)
+					continue;
+				auto band = y / tileSize;
+				auto &bandData = bands[band].data;
+				if(bandData.empty())
+					bandData.resize(static_cast<size_t>(getBandHeight(band)) * width * 3, 0.f);
+				auto *dstRow = bandData.data() + static_cast<size_t>(y - band * tileSize) * width * 3;
+				for(auto x = ex0; x < ex1; ++x) {
+					auto weight = wy * get_tile_blend_weight(x + 0.5f, cx0, cx1, width, halfBand);
+					if(weight <= 0.f)
+						continue;
+					auto *src = outputData.data() + (static_cast<size_t>(y - ey0) * w + (x - ex0)) * 3;
+					auto *dst = dstRow + static_cast<size_t>(x) * 3;
+					for(uint8_t c = 0; c < 3; ++c)
+						dst[c] += src[c] * weight;
+				}
+			}
+			++numCompletedTilesPerRow[tileY];
+			// Completing a row may also unblock bands further away, if the row's extent has been shifted over them
+			for(auto band = decltype(numTilesY) {0u}; band < numTilesY; ++band) {
+				if(!canWriteBand(band))
+					continue;
+				bands[band].written = true;
+				completedBands.push_back({band, std::move(bands[band].data)});
+				bands[band].data = {};
+			}
+			lock.unlock();
+
+			if(completedBands.empty())
+				continue;
+			std::scoped_lock outputLock {outputMutex};
+			for(auto &[band, data] : completedBands)
+				writeBand(band, data);
+			completedBands.clear();
+		}
+	};
+	std::vector<std::future<void>> workers;
+	for(auto i = decltype(numParallelTiles) {1u}; i < umath::min(numParallelTiles, numTiles); ++i)
+		workers.push_back(std::async(std::launch::async, processTiles));
+	processTiles();
+	for(auto &worker : workers)
+		worker.wait();
+	// Bands that have already been written are left as they are
+	if(cancelled || failed)
+		return false;
+	if(!reference.empty()) {
+		if(maxDeviation > denoise.tilingTolerance)
+			std::cout << "[Denoiser] WARNING: Tiled denoising deviates from the full frame result by up to " << maxDeviation << ", which exceeds the tolerance of " << denoise.tilingTolerance << "!" << std::endl;
+		else
+			std::cout << "[Denoiser] Tiled denoising deviates from the full frame result by up to " << maxDeviation << " (tolerance: " << denoise.tilingTolerance << ")." << std::endl;
+	}
+	return true;
+}
+
+pragma::scenekit::denoise::Denoiser::Denoiser() {}
+
+static bool denoise_image(oidn::DeviceRef &device, const pragma::scenekit::denoise::Info &denoise, const pragma::scenekit::denoise::ImageInputs &inputImages, const pragma::scenekit::denoise::ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+{
+	oidn::FilterRef filter = device.newFilter(denoise.lightmap ? "RTLightmap" : "RT");
+	if(!set_filter_images(filter, denoise, inputImages, outputImage))
+		return false;
+	return execute_filter(device, filter, fProgressCallback);
+}
+
+bool pragma::scenekit::denoise::Denoiser::Denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+{
+	// The device depends on the thread configuration of the call, so it has to be looked up every time
+	m_device = DenoiseService::GetInstance().GetDevice(denoise.numThreads, denoise.setAffinity);
+	if(m_device == nullptr)
+		return false;
+	auto numParallelTiles = is_cpu_device(*m_device) ? 1u : 2u;
+	auto tileSize = get_denoise_tile_size(denoise, numParallelTiles);
+	if(tileSize == 0)
+		return denoise_image(*m_device, denoise, inputImages, outputImage, fProgressCallback);
+	auto &device = *m_device;
+	return denoise_tiled(
+	  denoise, inputImages, outputImage, tileSize, numParallelTiles,
+	  [&device](const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback) { return denoise_image(device, denoise, inputImages, outputImage, fProgressCallback); }, fProgressCallback);
+}
+
+pragma::scenekit::denoise::DenoiseService &pragma::scenekit::denoise::DenoiseService::GetInstance()
+{
+	static DenoiseService service {};
+	return service;
+}
+
+pragma::scenekit::denoise::DenoiseService::~DenoiseService() { Clear(); }
+
+std::shared_ptr<oidn::DeviceRef> pragma::scenekit::denoise::DenoiseService::FindOrCreateDevice(const DeviceKey &key)
+{
+	auto it = std::find_if(m_devices.begin(), m_devices.end(), [&key](const std::pair<DeviceKey, std::shared_ptr<oidn::DeviceRef>> &pair) { return pair.first == key; });
+	if(it != m_devices.end())
+		return it->second;
+	auto device = create_device(key.numThreads, key.setAffinity);
+	if(device)
+		m_devices.push_back({key, device});
+	return device;
+}
+
+std::shared_ptr<oidn::DeviceRef> pragma::scenekit::denoise::DenoiseService::GetDevice(uint32_t numThreads, bool setAffinity)
+{
+	std::scoped_lock lock {m_mutex};
+	return FindOrCreateDevice({numThreads, setAffinity});
+}
+
+void pragma::scenekit::denoise::DenoiseService::SetMaxCachedFilterCount(uint32_t count)
+{
+	std::scoped_lock lock {m_mutex};
+	m_maxCachedFilters = count;
+	TrimCache(m_maxCachedFilters + m_numReservedFilters);
+}
 
-	if(optImgBufferAlbedo) {
-		inputs.albedoImage.data = static_cast<uint8_t *>(optImgBufferAlbedo->GetData());
-		inputs.albedoImage.format = optImgBufferAlbedo->GetFormat();
+size_t pragma::scenekit::denoise::DenoiseService::GetCachedFilterCount() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_filters.size();
+}
+
+void pragma::scenekit::denoise::DenoiseService::Clear()
+{
+	std::scoped_lock lock {m_mutex};
+	TrimCache(0);
+	// Filters that are still in use keep their device alive
+	m_devices.clear();
+}
+
+void pragma::scenekit::denoise::DenoiseService::ReserveCachedFilters(uint32_t count)
+{
+	std::scoped_lock lock {m_mutex};
+	m_numReservedFilters += count;
+}
+
+void pragma::scenekit::denoise::DenoiseService::ReleaseCachedFilterReservation(uint32_t count)
+{
+	std::scoped_lock lock {m_mutex};
+	m_numReservedFilters -= umath::min(count, m_numReservedFilters);
+	TrimCache(m_maxCachedFilters + m_numReservedFilters);
+}
+
+void pragma::scenekit::denoise::DenoiseService::TrimCache(size_t maxFilters)
+{
+	while(m_filters.size() > maxFilters) {
+		// Evict the least recently used filter that isn't in use
+		auto itEvict = m_filters.end();
+		for(auto it = m_filters.begin(); it != m_filters.end(); ++it) {
+			if(it->use_count() > 1)
+				continue;
+			if(itEvict == m_filters.end() || (*it)->lastUsed < (*itEvict)->lastUsed)
+				itEvict = it;
+		}
+		if(itEvict == m_filters.end())
+			break;
+		m_filters.erase(itEvict);
 	}
-	if(optImgBufferNormal) {
-		inputs.normalImage.data = static_cast<uint8_t *>(optImgBufferNormal->GetData());
-		inputs.normalImage.format = optImgBufferNormal->GetFormat();
+}
+
+std::shared_ptr<pragma::scenekit::denoise::DenoiseService::CachedFilter> pragma::scenekit::denoise::DenoiseService::AcquireFilter(const FilterKey &key)
+{
+	std::scoped_lock lock {m_mutex};
+	for(auto &cachedFilter : m_filters) {
+		// Filters with a use count > 1 are currently used by another thread
+		if(cachedFilter->key != key || cachedFilter.use_count() > 1)
+			continue;
+		cachedFilter->lastUsed = ++m_useCounter;
+		return cachedFilter;
 	}
+	auto device = FindOrCreateDevice(key.device);
+	if(!device)
+		return nullptr;
+	auto cachedFilter = std::make_shared<CachedFilter>();
+	cachedFilter->key = key;
+	cachedFilter->device = device;
+	cachedFilter->filter = std::make_shared<oidn::FilterRef>(device->newFilter(key.lightmap ? "RTLightmap" : "RT"));
+	cachedFilter->lastUsed = ++m_useCounter;
+	m_filters.push_back(cachedFilter);
+	TrimCache(m_maxCachedFilters + m_numReservedFilters);
+	return cachedFilter;
+}
+
+bool pragma::scenekit::denoise::DenoiseService::Denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+{
+	auto device = GetDevice(denoise.numThreads, denoise.setAffinity);
+	if(!device)
+		return false;
+	// CPU devices already use all of their threads for a single filter, other devices can execute multiple tiles concurrently
+	auto numParallelTiles = is_cpu_device(*device) ? 1u : 2u;
+	auto tileSize = get_denoise_tile_size(denoise, numParallelTiles);
+	if(tileSize == 0)
+		return DenoiseImage(denoise, inputImages, outputImage, fProgressCallback);
+	return denoise_tiled(
+	  denoise, inputImages, outputImage, tileSize, numParallelTiles, [this](const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback) { return DenoiseImage(denoise, inputImages, outputImage, fProgressCallback); },
+	  fProgressCallback);
+}
+
+bool pragma::scenekit::denoise::DenoiseService::DenoiseImage(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback)
+{
+	FilterKey key {};
+	key.device = {denoise.numThreads, denoise.setAffinity};
+	key.quality = denoise.quality;
+	key.lightmap = denoise.lightmap;
+	key.hdr = denoise.hdr;
+	key.width = denoise.width;
+	key.height = denoise.height;
+	key.colorFormat = inputImages.beautyImage.format;
+	if(!denoise.lightmap) {
+		if(inputImages.albedoImage.data)
+			key.albedoFormat = inputImages.albedoImage.format;
+		if(inputImages.normalImage.data)
+			key.normalFormat = inputImages.normalImage.format;
+	}
+	key.outputFormat = outputImage.format;
+	key.maxMemoryMB = denoise.maxMemoryMB;
+
+	auto cachedFilter = AcquireFilter(key);
+	if(!cachedFilter)
+		return false;
+	std::scoped_lock lock {cachedFilter->mutex};
+	// Only the image buffers have to be re-bound, OIDN only re-initializes the filter on commit if its configuration has changed
+	auto &filter = *cachedFilter->filter;
+	if(!set_filter_images(filter, denoise, inputImages, outputImage))
+		return false;
+	return execute_filter(*cachedFilter->device, filter, fProgressCallback);
+}
+
+bool pragma::scenekit::denoise::denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback) { return DenoiseService::GetInstance().Denoise(denoise, inputImages, outputImage, fProgressCallback); }
+
+bool pragma::scenekit::denoise::denoise(const Info &denoiseInfo, uimg::ImageBuffer &imgBuffer, uimg::ImageBuffer *optImgBufferAlbedo, uimg::ImageBuffer *optImgBufferNormal, const std::function<bool(float)> &fProgressCallback)
+{
+	ImageInputs inputs {};
+	inputs.beautyImage = create_image_view(imgBuffer);
+	if(optImgBufferAlbedo)
+		inputs.albedoImage = create_image_view(*optImgBufferAlbedo);
+	if(optImgBufferNormal)
+		inputs.normalImage = create_image_view(*optImgBufferNormal);
 
-	ImageData output {};
-	output.data = static_cast<uint8_t *>(imgBuffer.GetData());
-	output.format = imgBuffer.GetFormat();
+	// Denoised in place, the alpha channel (if there is one) is left untouched
+	auto output = create_image_view(imgBuffer);
 
-	return denoiser.Denoise(denoiseInfo, inputs, output, fProgressCallback);
+	return DenoiseService::GetInstance().Denoise(denoiseInfo, inputs, output, fProgressCallback);
 }
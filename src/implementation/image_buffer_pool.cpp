@@ -0,0 +1,157 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :image_buffer_pool;
+
+pragma::scenekit::ImageBufferPool &pragma::scenekit::ImageBufferPool::GetInstance()
+{
+	static ImageBufferPool pool {};
+	return pool;
+}
+
+pragma::scenekit::ImageBufferPool::ImageBufferPool() : m_state {std::make_shared<State>()} {}
+
+size_t pragma::scenekit::ImageBufferPool::KeyHasher::operator()(const Key &key) const
+{
+	auto hash = util::hash_combine<uint64_t>(0u, key.width);
+	hash = util::hash_combine<uint64_t>(hash, key.height);
+	return util::hash_combine<uint64_t>(hash, umath::to_integral(key.format));
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::ImageBufferPool::Allocate(const Key &key, bool prefault)
+{
+	auto buffer = uimg::ImageBuffer::Create(key.width, key.height, key.format);
+	if(prefault)
+		std::memset(buffer->GetData(), 0, buffer->GetSize());
+	return buffer;
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::ImageBufferPool::Wrap(const Key &key, const std::shared_ptr<uimg::ImageBuffer> &buffer)
+{
+	// The returned pointer doesn't own the buffer, the deleter hands the owning pointer back to the pool instead
+	std::weak_ptr<State> wpState = m_state;
+	auto deleter = [wpState, key, buffer](uimg::ImageBuffer *) {
+		auto state = wpState.lock();
+		if(state)
+			state->Return(key, buffer);
+	};
+	return std::shared_ptr<uimg::ImageBuffer> {buffer.get(), deleter};
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::ImageBufferPool::Acquire(uint32_t width, uint32_t height, uimg::Format format)
+{
+	Key key {width, height, format};
+	std::shared_ptr<uimg::ImageBuffer> buffer = nullptr;
+	auto prefault = false;
+	{
+		std::scoped_lock lock {m_state->mutex};
+		auto it = m_state->idleBuffers.find(key);
+		if(it != m_state->idleBuffers.end() && !it->second.empty()) {
+			buffer = std::move(it->second.back());
+			it->second.pop_back();
+			m_state->idleMemory -= buffer->GetSize();
+			++m_state->hits;
+		}
+		else
+			++m_state->misses;
+		prefault = m_state->prefault;
+	}
+	if(!buffer)
+		buffer = Allocate(key, prefault);
+	return Wrap(key, buffer);
+}
+
+void pragma::scenekit::ImageBufferPool::Preallocate(uint32_t width, uint32_t height, uimg::Format format, uint32_t count)
+{
+	Key key {width, height, format};
+	auto prefault = IsPrefaultEnabled();
+	for(uint32_t i = 0; i < count; ++i)
+		m_state->Return(key, Allocate(key, prefault));
+}
+
+void pragma::scenekit::ImageBufferPool::Clear()
+{
+	std::scoped_lock lock {m_state->mutex};
+	m_state->idleBuffers.clear();
+	m_state->idleMemory = 0;
+}
+
+void pragma::scenekit::ImageBufferPool::SetMemoryCap(size_t capInBytes)
+{
+	std::scoped_lock lock {m_state->mutex};
+	m_state->memoryCap = capInBytes;
+	m_state->Evict(0, nullptr);
+}
+size_t pragma::scenekit::ImageBufferPool::GetMemoryCap() const
+{
+	std::scoped_lock lock {m_state->mutex};
+	return m_state->memoryCap;
+}
+void pragma::scenekit::ImageBufferPool::SetPrefaultEnabled(bool enabled)
+{
+	std::scoped_lock lock {m_state->mutex};
+	m_state->prefault = enabled;
+}
+bool pragma::scenekit::ImageBufferPool::IsPrefaultEnabled() const
+{
+	std::scoped_lock lock {m_state->mutex};
+	return m_state->prefault;
+}
+size_t pragma::scenekit::ImageBufferPool::GetIdleMemory() const
+{
+	std::scoped_lock lock {m_state->mutex};
+	return m_state->idleMemory;
+}
+uint64_t pragma::scenekit::ImageBufferPool::GetHitCount() const
+{
+	std::scoped_lock lock {m_state->mutex};
+	return m_state->hits;
+}
+uint64_t pragma::scenekit::ImageBufferPool::GetMissCount() const
+{
+	std::scoped_lock lock {m_state->mutex};
+	return m_state->misses;
+}
+
+void pragma::scenekit::ImageBufferPool::State::Return(const Key &key, const std::shared_ptr<uimg::ImageBuffer> &buffer)
+{
+	// Buffers that have been resized or converted in the meantime no longer match their key
+	if(buffer->GetWidth() != key.width || buffer->GetHeight() != key.height || buffer->GetFormat() != key.format)
+		return;
+	auto size = buffer->GetSize();
+	std::scoped_lock lock {mutex};
+	if(size > memoryCap)
+		return;
+	Evict(size, &key);
+	if(idleMemory + size > memoryCap)
+		return;
+	auto &buffers = idleBuffers[key];
+	if(buffers.size() == buffers.capacity())
+		buffers.reserve(buffers.size() * 1.5 + 100);
+	buffers.push_back(buffer);
+	idleMemory += size;
+}
+
+void pragma::scenekit::ImageBufferPool::State::Evict(size_t requiredSize, const Key *optKeep)
+{
+	// Buffers with the key that is being returned are kept, evicting them wouldn't free up anything for it
+	for(auto it = idleBuffers.begin(); it != idleBuffers.end() && idleMemory + requiredSize > memoryCap;) {
+		if(optKeep && it->first == *optKeep) {
+			++it;
+			continue;
+		}
+		auto &buffers = it->second;
+		while(!buffers.empty() && idleMemory + requiredSize > memoryCap) {
+			idleMemory -= buffers.back()->GetSize();
+			buffers.pop_back();
+		}
+		if(buffers.empty())
+			it = idleBuffers.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,132 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :image_dump_writer;
+import :image_buffer_pool;
+
+pragma::scenekit::ImageDumpWriter::ImageDumpWriter(size_t maxPendingBytes) : m_maxPendingBytes {maxPendingBytes} {}
+
+pragma::scenekit::ImageDumpWriter::~ImageDumpWriter() { Close(); }
+
+size_t pragma::scenekit::ImageDumpWriter::GetPendingDumpCount() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_pendingDumps.size() + m_numReservedSlots;
+}
+
+bool pragma::scenekit::ImageDumpWriter::ReserveSlot(const std::string &fileName, size_t size)
+{
+	std::scoped_lock lock {m_mutex};
+	if(m_closing)
+		return false;
+	// A single dump that exceeds the limit on its own is still accepted if nothing else is pending
+	if(m_pendingBytes > 0 && m_pendingBytes + size > m_maxPendingBytes) {
+		++m_numDroppedDumps;
+		// Only the first drop is reported right away, the total is reported once the writer has caught up
+		if(m_numDroppedSinceReport++ == 0)
+			std::cout << "[ImageDumpWriter] Dump queue is full, dropping image dump '" << fileName << "'!" << std::endl;
+		return false;
+	}
+	++m_numReservedSlots;
+	m_pendingBytes += size;
+	if(!m_thread.joinable())
+		m_thread = std::thread {[this]() { Run(); }};
+	return true;
+}
+
+void pragma::scenekit::ImageDumpWriter::Enqueue(Dump &&dump)
+{
+	m_mutex.lock();
+	--m_numReservedSlots;
+	m_pendingDumps.push_back(std::move(dump));
+	m_mutex.unlock();
+	m_pendingCondition.notify_one();
+}
+
+bool pragma::scenekit::ImageDumpWriter::Write(const std::string &fileName, const uimg::ImageBuffer &imgBuf, uimg::ImageFormat format)
+{
+	auto size = imgBuf.GetSize();
+	if(!ReserveSlot(fileName, size))
+		return false;
+	auto snapshot = ImageBufferPool::GetInstance().Acquire(imgBuf.GetWidth(), imgBuf.GetHeight(), imgBuf.GetFormat());
+	std::memcpy(snapshot->GetData(), imgBuf.GetData(), size);
+	Enqueue({fileName, std::move(snapshot), format, size});
+	return true;
+}
+
+bool pragma::scenekit::ImageDumpWriter::Write(const std::string &fileName, std::shared_ptr<uimg::ImageBuffer> &&snapshot, uimg::ImageFormat format)
+{
+	auto size = snapshot->GetSize();
+	if(!ReserveSlot(fileName, size)) {
+		snapshot = nullptr; // Dropped snapshots go back to the pool right away
+		return false;
+	}
+	Enqueue({fileName, std::move(snapshot), format, size});
+	return true;
+}
+
+void pragma::scenekit::ImageDumpWriter::Flush()
+{
+	std::unique_lock lock {m_mutex};
+	m_writtenCondition.wait(lock, [this]() { return (m_pendingDumps.empty() && m_numReservedSlots == 0 && !m_writing) || !m_thread.joinable(); });
+}
+
+void pragma::scenekit::ImageDumpWriter::Close()
+{
+	if(!m_thread.joinable())
+		return;
+	Flush();
+	m_mutex.lock();
+	m_closing = true;
+	m_mutex.unlock();
+	m_pendingCondition.notify_one();
+	m_thread.join();
+}
+
+void pragma::scenekit::ImageDumpWriter::Run()
+{
+	std::unique_lock lock {m_mutex};
+	for(;;) {
+		m_pendingCondition.wait(lock, [this]() { return !m_pendingDumps.empty() || m_closing; });
+		if(m_pendingDumps.empty())
+			break;
+		auto dump = std::move(m_pendingDumps.front());
+		m_pendingDumps.pop_front();
+		m_writing = true;
+		lock.unlock();
+
+		if(WriteDump(dump))
+			++m_numWrittenDumps;
+		auto size = dump.size;
+		dump = {}; // Return the snapshot to the pool
+
+		lock.lock();
+		m_writing = false;
+		m_pendingBytes -= size;
+		if(m_pendingDumps.empty() && m_numDroppedSinceReport > 0) {
+			std::cout << "[ImageDumpWriter] " << m_numDroppedSinceReport << " image dump(s) were dropped because the dump queue was full." << std::endl;
+			m_numDroppedSinceReport = 0;
+		}
+		m_writtenCondition.notify_all();
+	}
+}
+
+bool pragma::scenekit::ImageDumpWriter::WriteDump(const Dump &dump)
+{
+	filemanager::create_path(ufile::get_path_from_filename(dump.fileName));
+	auto f = filemanager::open_file(dump.fileName, filemanager::FileMode::Write | filemanager::FileMode::Binary);
+	if(!f) {
+		std::cout << "[ImageDumpWriter] Failed to dump image: Could not open file '" << dump.fileName << "' for writing!" << std::endl;
+		return false;
+	}
+	fsys::File fp {f};
+	if(!uimg::save_image(fp, *dump.image, dump.format)) {
+		std::cout << "[ImageDumpWriter] Failed to dump image '" << dump.fileName << "': Unknown error!" << std::endl;
+		return false;
+	}
+	return true;
+}
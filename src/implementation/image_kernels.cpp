@@ -0,0 +1,214 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENEKIT_ENABLE_SSE2
+#include <immintrin.h>
+#endif
+#if defined(SCENEKIT_ENABLE_SSE2) && defined(__F16C__)
+#define SCENEKIT_ENABLE_F16C
+#endif
+
+module pragma.scenekit;
+
+import :image_kernels;
+
+namespace {
+	constexpr uint32_t CHANNEL_COUNT = 4;
+#ifdef SCENEKIT_ENABLE_SSE2
+	inline __m128 make_opaque(__m128 px)
+	{
+		const auto rgbMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		const auto alphaOne = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+		return _mm_or_ps(_mm_and_ps(px, rgbMask), alphaOne);
+	}
+#endif
+#ifdef __AVX2__
+	inline __m256 make_opaque(__m256 px)
+	{
+		const auto alphaOne = _mm256_set_ps(1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f);
+		return _mm256_blend_ps(px, alphaOne, 0b1000'1000);
+	}
+#endif
+
+	// See https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+	inline uint16_t float_to_half(float f)
+	{
+		constexpr uint32_t f32Infinity = 255u << 23;
+		constexpr uint32_t f16Max = (127u + 16u) << 23;
+		constexpr uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		constexpr uint32_t signMask = 0x8000'0000u;
+
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		auto sign = u & signMask;
+		u ^= sign;
+
+		uint16_t result;
+		if(u >= f16Max)
+			result = (u > f32Infinity) ? 0x7e00 : 0x7c00; // NaN or Inf
+		else if(u < (113u << 23)) {
+			// Denormalized half, let the FPU do the rounding
+			float fu, fMagic;
+			std::memcpy(&fu, &u, sizeof(u));
+			std::memcpy(&fMagic, &denormMagic, sizeof(denormMagic));
+			fu += fMagic;
+			uint32_t r;
+			std::memcpy(&r, &fu, sizeof(r));
+			result = static_cast<uint16_t>(r - denormMagic);
+		}
+		else {
+			auto mantissaOdd = (u >> 13) & 1u;
+			u += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu;
+			u += mantissaOdd;
+			result = static_cast<uint16_t>(u >> 13);
+		}
+		return result | static_cast<uint16_t>(sign >> 16);
+	}
+
+	// Swaps pixel a with pixel b and makes both opaque. a and b may refer to the same pixel.
+	inline void swap_opaque(const float *srcA, const float *srcB, float *dstA, float *dstB)
+	{
+#ifdef SCENEKIT_ENABLE_SSE2
+		auto a = _mm_loadu_ps(srcA);
+		auto b = _mm_loadu_ps(srcB);
+		_mm_storeu_ps(dstA, make_opaque(b));
+		_mm_storeu_ps(dstB, make_opaque(a));
+#else
+		float a[CHANNEL_COUNT];
+		float b[CHANNEL_COUNT];
+		std::memcpy(a, srcA, sizeof(a));
+		std::memcpy(b, srcB, sizeof(b));
+		for(uint32_t i = 0; i < 3; ++i) {
+			dstA[i] = b[i];
+			dstB[i] = a[i];
+		}
+		dstA[3] = 1.f;
+		dstB[3] = 1.f;
+#endif
+	}
+
+	inline void copy_opaque(const float *src, float *dst)
+	{
+#ifdef SCENEKIT_ENABLE_SSE2
+		_mm_storeu_ps(dst, make_opaque(_mm_loadu_ps(src)));
+#else
+		std::memmove(dst, src, sizeof(float) * 3);
+		dst[3] = 1.f;
+#endif
+	}
+
+	void copy_row_opaque(const float *src, float *dst, uint32_t w)
+	{
+		uint32_t x = 0;
+#ifdef __AVX2__
+		for(; x + 2 <= w; x += 2) {
+			auto offset = x * CHANNEL_COUNT;
+			_mm256_storeu_ps(dst + offset, make_opaque(_mm256_loadu_ps(src + offset)));
+		}
+#endif
+		for(; x < w; ++x) {
+			auto offset = x * CHANNEL_COUNT;
+			copy_opaque(src + offset, dst + offset);
+		}
+	}
+
+	// Swaps the pixels of two rows without mirroring them
+	void swap_rows_opaque(const float *srcA, const float *srcB, float *dstA, float *dstB, uint32_t w, bool sameRow)
+	{
+		if(sameRow) {
+			copy_row_opaque(srcA, dstA, w);
+			return;
+		}
+		uint32_t x = 0;
+#ifdef __AVX2__
+		for(; x + 2 <= w; x += 2) {
+			auto offset = x * CHANNEL_COUNT;
+			auto a = _mm256_loadu_ps(srcA + offset);
+			auto b = _mm256_loadu_ps(srcB + offset);
+			_mm256_storeu_ps(dstA + offset, make_opaque(b));
+			_mm256_storeu_ps(dstB + offset, make_opaque(a));
+		}
+#endif
+		for(; x < w; ++x) {
+			auto offset = x * CHANNEL_COUNT;
+			swap_opaque(srcA + offset, srcB + offset, dstA + offset, dstB + offset);
+		}
+	}
+
+	// Swaps the pixels of two rows and mirrors them horizontally
+	void swap_rows_mirrored_opaque(const float *srcA, const float *srcB, float *dstA, float *dstB, uint32_t w, bool sameRow)
+	{
+		// If both rows are the same, every pixel pair only has to be swapped once
+		auto xEnd = sameRow ? (w + 1) / 2 : w;
+		for(uint32_t x = 0; x < xEnd; ++x) {
+			auto offsetA = x * CHANNEL_COUNT;
+			auto offsetB = (w - 1 - x) * CHANNEL_COUNT;
+			swap_opaque(srcA + offsetA, srcB + offsetB, dstA + offsetA, dstB + offsetB);
+		}
+	}
+};
+
+void pragma::scenekit::image_kernels::ingest_tile(const float *src, float *dst, const TileIngestInfo &info)
+{
+	auto w = info.width;
+	auto h = info.height;
+	auto rowSize = static_cast<size_t>(w) * CHANNEL_COUNT;
+	// Every pixel is swapped with its mirrored counterpart, which means both are read before either is written.
+	// This allows the kernel to operate in-place.
+	auto yEnd = info.flipVertically ? (h + 1) / 2 : h;
+	for(uint32_t y = 0; y < yEnd; ++y) {
+		auto y2 = info.flipVertically ? (h - 1 - y) : y;
+		auto *srcA = src + y * rowSize;
+		auto *srcB = src + y2 * rowSize;
+		auto *dstA = dst + y * rowSize;
+		auto *dstB = dst + y2 * rowSize;
+		if(info.flipHorizontally)
+			swap_rows_mirrored_opaque(srcA, srcB, dstA, dstB, w, y == y2);
+		else
+			swap_rows_opaque(srcA, srcB, dstA, dstB, w, y == y2);
+	}
+}
+
+void pragma::scenekit::image_kernels::convert_f32_to_f16(const float *src, uint16_t *dst, size_t count)
+{
+	size_t i = 0;
+#ifdef SCENEKIT_ENABLE_F16C
+#ifdef __AVX__
+	for(; i + 8 <= count; i += 8)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for(; i + 4 <= count; i += 4)
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for(; i < count; ++i)
+		dst[i] = float_to_half(src[i]);
+}
+
+size_t pragma::scenekit::image_kernels::compute_alpha_coverage(const float *src, uint8_t *dstMask, size_t numPixels)
+{
+	size_t i = 0;
+	size_t numCovered = 0;
+#ifdef SCENEKIT_ENABLE_SSE2
+	const auto zero = _mm_setzero_ps();
+	for(; i + 4 <= numPixels; i += 4) {
+		auto *px = src + i * CHANNEL_COUNT;
+		// Gather the alpha values of four pixels into a single register
+		auto a01 = _mm_shuffle_ps(_mm_loadu_ps(px), _mm_loadu_ps(px + CHANNEL_COUNT), _MM_SHUFFLE(3, 3, 3, 3));
+		auto a23 = _mm_shuffle_ps(_mm_loadu_ps(px + CHANNEL_COUNT * 2), _mm_loadu_ps(px + CHANNEL_COUNT * 3), _MM_SHUFFLE(3, 3, 3, 3));
+		auto alpha = _mm_shuffle_ps(a01, a23, _MM_SHUFFLE(2, 0, 2, 0));
+		auto bits = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(alpha, zero)));
+		for(uint32_t j = 0; j < 4; ++j)
+			dstMask[i + j] = (bits >> j) & 1u;
+		numCovered += std::popcount(bits);
+	}
+#endif
+	for(; i < numPixels; ++i) {
+		auto covered = src[i * CHANNEL_COUNT + 3] > 0.f;
+		dstMask[i] = covered ? 1 : 0;
+		numCovered += covered ? 1 : 0;
+	}
+	return numCovered;
+}
@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :latency_histogram;
+
+uint64_t pragma::scenekit::LatencyHistogram::GetTimestamp() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+void pragma::scenekit::LatencyHistogram::Record(uint64_t durationNs)
+{
+	uint32_t bucket = (durationNs > 0) ? (std::bit_width(durationNs) - 1) : 0;
+	bucket = std::min(bucket, BUCKET_COUNT - 1);
+	m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_total.fetch_add(durationNs, std::memory_order_relaxed);
+	auto curMax = m_max.load(std::memory_order_relaxed);
+	while(durationNs > curMax && !m_max.compare_exchange_weak(curMax, durationNs, std::memory_order_relaxed))
+		;
+}
+
+void pragma::scenekit::LatencyHistogram::Reset()
+{
+	for(auto &bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_total.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+double pragma::scenekit::LatencyHistogram::GetMean() const
+{
+	auto count = GetCount();
+	return (count > 0) ? (static_cast<double>(GetTotal()) / count) : 0.0;
+}
+
+uint64_t pragma::scenekit::LatencyHistogram::GetPercentile(double percentile) const
+{
+	std::array<uint64_t, BUCKET_COUNT> counts;
+	uint64_t total = 0;
+	for(uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+		counts[i] = GetBucketCount(i);
+		total += counts[i];
+	}
+	if(total == 0)
+		return 0;
+	auto target = static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 1.0) * total));
+	uint64_t sum = 0;
+	for(uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+		sum += counts[i];
+		if(sum >= target && counts[i] > 0)
+			return (i + 1 < BUCKET_COUNT) ? GetBucketLowerBound(i + 1) : GetMax();
+	}
+	return GetMax();
+}
@@ -0,0 +1,360 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :lightmap_atlas;
+import :image_kernels;
+
+// Unoccupied texels around a chart that are denoised along with it. They are filled with the nearest chart texels,
+// so the denoiser doesn't treat the chart borders as edges.
+constexpr uint32_t ATLAS_CHART_PADDING = 4;
+// Upper limit for the number of additional filters that are kept cached while the charts of an atlas are denoised
+constexpr uint32_t ATLAS_MAX_RESERVED_FILTERS = 64;
+
+namespace {
+	struct ChartBounds {
+		int64_t x0 = 0;
+		int64_t y0 = 0;
+		int64_t x1 = 0; // Exclusive
+		int64_t y1 = 0; // Exclusive
+		uint32_t numTexels = 0;
+		uint32_t chartIndex = std::numeric_limits<uint32_t>::max();
+	};
+
+	// Charts are denoised at a small set of sizes, so charts of similar size share the same cached filter
+	// instead of evicting each other from the DenoiseService cache
+	uint32_t get_chart_bucket_size(uint32_t size)
+	{
+		constexpr uint32_t minSize = 16;
+		constexpr uint32_t largeSizeStep = 256;
+		if(size > largeSizeStep)
+			return ((size + largeSizeStep - 1) / largeSizeStep) * largeSizeStep;
+		auto bucketSize = minSize;
+		while(bucketSize < size)
+			bucketSize *= 2;
+		return bucketSize;
+	}
+
+	bool padded_bounds_overlap(const ChartBounds &a, const ChartBounds &b, int64_t padding) { return (a.x0 - padding < b.x1 + padding) && (b.x0 - padding < a.x1 + padding) && (a.y0 - padding < b.y1 + padding) && (b.y0 - padding < a.y1 + padding); }
+
+	// Copies the RGB data of the chart region. Texels that don't belong to the chart are filled with the nearest chart texel
+	// in the same row, rows without any chart texels are filled with the nearest filled row.
+	void fill_chart_region(const float *imgData, uint32_t imgWidth, const std::vector<uint32_t> &chartMap, uint32_t chartId, const pragma::scenekit::denoise::AtlasChart &chart, std::vector<float> &outData)
+	{
+		auto w = chart.w;
+		auto h = chart.h;
+		outData.resize(static_cast<size_t>(w) * h * 3);
+		auto copyTexel = [&outData](const float *src, size_t dstIdx) { std::memcpy(outData.data() + dstIdx * 3, src, sizeof(float) * 3); };
+		std::vector<uint8_t> rowFilled(h, 0);
+		for(uint32_t y = 0; y < h; ++y) {
+			auto imgRowOffset = static_cast<size_t>(chart.y + y) * imgWidth + chart.x;
+			auto dstRowOffset = static_cast<size_t>(y) * w;
+			int64_t prev = -1;
+			for(uint32_t x = 0; x < w; ++x) {
+				if(chartMap[imgRowOffset + x] != chartId)
+					continue;
+				copyTexel(imgData + (imgRowOffset + x) * 4, dstRowOffset + x);
+				for(auto gap = prev + 1; gap < x; ++gap) {
+					auto src = (prev >= 0 && gap - prev <= x - gap) ? prev : x;
+					copyTexel(imgData + (imgRowOffset + src) * 4, dstRowOffset + gap);
+				}
+				prev = x;
+			}
+			if(prev < 0)
+				continue;
+			for(auto gap = prev + 1; gap < w; ++gap)
+				copyTexel(imgData + (imgRowOffset + prev) * 4, dstRowOffset + gap);
+			rowFilled[y] = 1;
+		}
+		auto rowSize = static_cast<size_t>(w) * 3;
+		auto copyRow = [&](uint32_t src, uint32_t dst) { std::memcpy(outData.data() + dst * rowSize, outData.data() + src * rowSize, rowSize * sizeof(float)); };
+		int64_t prev = -1;
+		for(uint32_t y = 0; y < h; ++y) {
+			if(!rowFilled[y])
+				continue;
+			for(auto gap = prev + 1; gap < y; ++gap)
+				copyRow((prev >= 0 && gap - prev <= y - gap) ? prev : y, gap);
+			prev = y;
+		}
+		for(auto gap = prev + 1; gap < h; ++gap)
+			copyRow(prev, gap);
+	}
+
+	// Extends the RGB data of a w x h region to bucketW x bucketH by repeating the last column and row
+	void pad_chart_region(std::vector<float> &data, uint32_t w, uint32_t h, uint32_t bucketW, uint32_t bucketH)
+	{
+		if(bucketW == w && bucketH == h)
+			return;
+		data.resize(static_cast<size_t>(bucketW) * bucketH * 3);
+		// Rows are moved back to front, so the source rows haven't been overwritten yet
+		for(auto y = static_cast<int64_t>(h) - 1; y >= 0; --y) {
+			auto *src = data.data() + static_cast<size_t>(y) * w * 3;
+			auto *dst = data.data() + static_cast<size_t>(y) * bucketW * 3;
+			std::memmove(dst, src, static_cast<size_t>(w) * 3 * sizeof(float));
+			for(auto x = w; x < bucketW; ++x)
+				std::memcpy(dst + static_cast<size_t>(x) * 3, dst + static_cast<size_t>(w - 1) * 3, sizeof(float) * 3);
+		}
+		auto rowSize = static_cast<size_t>(bucketW) * 3;
+		for(auto y = h; y < bucketH; ++y)
+			std::memcpy(data.data() + y * rowSize, data.data() + (h - 1) * rowSize, rowSize * sizeof(float));
+	}
+};
+
+std::vector<pragma::scenekit::denoise::AtlasChart> pragma::scenekit::denoise::find_atlas_charts(const uimg::ImageBuffer &imgBuffer, uint32_t padding, std::vector<uint32_t> *optOutChartMap)
+{
+	if(imgBuffer.GetFormat() != uimg::Format::RGBA_FLOAT)
+		return {};
+	auto w = imgBuffer.GetWidth();
+	auto h = imgBuffer.GetHeight();
+	auto numTexels = static_cast<size_t>(w) * h;
+	std::vector<uint8_t> mask(numTexels);
+	if(image_kernels::compute_alpha_coverage(static_cast<const float *>(imgBuffer.GetData()), mask.data(), numTexels) == 0)
+		return {};
+
+	// Label the UV islands (8-connected texels) in a single pass, equivalent labels are tracked with a union-find
+	std::vector<uint32_t> labels(numTexels, 0);
+	std::vector<uint32_t> parents {0};
+	auto findRoot = [&parents](uint32_t label) {
+		while(parents[label] != label) {
+			parents[label] = parents[parents[label]];
+			label = parents[label];
+		}
+		return label;
+	};
+	for(uint32_t y = 0; y < h; ++y) {
+		for(uint32_t x = 0; x < w; ++x) {
+			auto i = static_cast<size_t>(y) * w + x;
+			if(!mask[i])
+				continue;
+			uint32_t label = 0;
+			auto merge = [&](uint32_t other) {
+				if(other == 0)
+					return;
+				if(label == 0) {
+					label = other;
+					return;
+				}
+				auto a = findRoot(label);
+				auto b = findRoot(other);
+				if(a != b)
+					parents[std::max(a, b)] = std::min(a, b);
+			};
+			if(x > 0)
+				merge(labels[i - 1]);
+			if(y > 0) {
+				auto up = i - w;
+				if(x > 0)
+					merge(labels[up - 1]);
+				merge(labels[up]);
+				if(x + 1 < w)
+					merge(labels[up + 1]);
+			}
+			if(label == 0) {
+				label = parents.size();
+				if(parents.size() == parents.capacity())
+					parents.reserve(parents.size() * 1.5 + 100);
+				parents.push_back(label);
+			}
+			labels[i] = label;
+		}
+	}
+
+	// Bounds of every island
+	std::vector<uint32_t> labelToIsland(parents.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<ChartBounds> islands;
+	for(uint32_t y = 0; y < h; ++y) {
+		for(uint32_t x = 0; x < w; ++x) {
+			auto label = labels[static_cast<size_t>(y) * w + x];
+			if(label == 0)
+				continue;
+			auto &islandIdx = labelToIsland[findRoot(label)];
+			if(islandIdx == std::numeric_limits<uint32_t>::max()) {
+				islandIdx = islands.size();
+				islands.push_back({x, y, x + 1, y + 1, 0});
+			}
+			auto &island = islands[islandIdx];
+			island.x0 = std::min<int64_t>(island.x0, x);
+			island.y0 = std::min<int64_t>(island.y0, y);
+			island.x1 = std::max<int64_t>(island.x1, x + 1);
+			island.y1 = std::max<int64_t>(island.y1, y + 1);
+			++island.numTexels;
+		}
+	}
+
+	// Merge islands with overlapping padded bounds into charts, until all padded chart bounds are disjoint
+	std::vector<uint32_t> islandOrder(islands.size());
+	std::iota(islandOrder.begin(), islandOrder.end(), 0);
+	std::sort(islandOrder.begin(), islandOrder.end(), [&islands](uint32_t a, uint32_t b) { return islands[a].x0 < islands[b].x0; });
+	std::vector<ChartBounds> chartBounds;
+	chartBounds.reserve(islands.size());
+	std::vector<std::vector<uint32_t>> chartIslands;
+	chartIslands.reserve(islands.size());
+	for(auto islandIdx : islandOrder) {
+		chartBounds.push_back(islands[islandIdx]);
+		chartIslands.push_back({islandIdx});
+	}
+	auto pad = static_cast<int64_t>(padding);
+	for(auto merged = true; merged;) {
+		merged = false;
+		for(size_t i = 0; i < chartBounds.size(); ++i) {
+			auto &a = chartBounds[i];
+			if(a.numTexels == 0)
+				continue;
+			// Charts are sorted by their left edge, so the search can stop at the first chart that starts to the right of this one
+			for(auto j = i + 1; j < chartBounds.size() && chartBounds[j].x0 - pad < a.x1 + pad; ++j) {
+				auto &b = chartBounds[j];
+				if(b.numTexels == 0 || !padded_bounds_overlap(a, b, pad))
+					continue;
+				a.x0 = std::min(a.x0, b.x0);
+				a.y0 = std::min(a.y0, b.y0);
+				a.x1 = std::max(a.x1, b.x1);
+				a.y1 = std::max(a.y1, b.y1);
+				a.numTexels += b.numTexels;
+				b.numTexels = 0;
+				chartIslands[i].insert(chartIslands[i].end(), chartIslands[j].begin(), chartIslands[j].end());
+				chartIslands[j].clear();
+				merged = true;
+			}
+		}
+	}
+
+	std::vector<AtlasChart> charts;
+	for(size_t i = 0; i < chartBounds.size(); ++i) {
+		auto &bounds = chartBounds[i];
+		if(bounds.numTexels == 0)
+			continue;
+		for(auto islandIdx : chartIslands[i])
+			islands[islandIdx].chartIndex = charts.size();
+		AtlasChart chart {};
+		chart.x = std::max<int64_t>(bounds.x0 - pad, 0);
+		chart.y = std::max<int64_t>(bounds.y0 - pad, 0);
+		chart.w = std::min<int64_t>(bounds.x1 + pad, w) - chart.x;
+		chart.h = std::min<int64_t>(bounds.y1 + pad, h) - chart.y;
+		chart.numTexels = bounds.numTexels;
+		charts.push_back(chart);
+	}
+
+	if(optOutChartMap) {
+		auto &chartMap = *optOutChartMap;
+		chartMap.resize(numTexels);
+		for(size_t i = 0; i < numTexels; ++i) {
+			auto label = labels[i];
+			chartMap[i] = (label != 0) ? (islands[labelToIsland[findRoot(label)]].chartIndex + 1) : 0;
+		}
+	}
+	return charts;
+}
+
+bool pragma::scenekit::denoise::denoise_atlas(const Info &denoise, uimg::ImageBuffer &imgBuffer, std::vector<AtlasChart> *optOutCharts, const std::function<bool(float)> &fProgressCallback)
+{
+	std::vector<uint32_t> chartMap;
+	auto charts = find_atlas_charts(imgBuffer, ATLAS_CHART_PADDING, &chartMap);
+	if(charts.empty()) {
+		if(optOutCharts)
+			optOutCharts->clear();
+		auto info = denoise;
+		info.lightmap = true;
+		return pragma::scenekit::denoise::denoise(info, imgBuffer, nullptr, nullptr, fProgressCallback);
+	}
+
+	// Largest charts first, so the workers finish at roughly the same time. Charts of the same size bucket are grouped,
+	// so consecutive charts of a worker can re-use the same filter.
+	std::vector<std::pair<uint32_t, uint32_t>> bucketSizes(charts.size());
+	for(size_t i = 0; i < charts.size(); ++i)
+		bucketSizes[i] = {get_chart_bucket_size(charts[i].w), get_chart_bucket_size(charts[i].h)};
+	std::vector<uint32_t> order(charts.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&bucketSizes](uint32_t a, uint32_t b) {
+		auto &sa = bucketSizes[a];
+		auto &sb = bucketSizes[b];
+		auto areaA = static_cast<uint64_t>(sa.first) * sa.second;
+		auto areaB = static_cast<uint64_t>(sb.first) * sb.second;
+		return (areaA != areaB) ? (areaA > areaB) : (sa > sb);
+	});
+	uint32_t numBuckets = 0;
+	for(size_t i = 0; i < order.size(); ++i) {
+		if(i == 0 || bucketSizes[order[i]] != bucketSizes[order[i - 1]])
+			++numBuckets;
+	}
+	uint64_t totalArea = 0;
+	for(auto &chart : charts)
+		totalArea += static_cast<uint64_t>(chart.w) * chart.h;
+
+	// Small charts don't scale well across the denoiser threads, so the threads are split between concurrent charts instead.
+	// The charts are processed on dedicated threads, since denoise_atlas may itself be called from a post-processing pool
+	// thread, where waiting on other pool jobs could deadlock and would bypass the worker budget of the tile managers.
+	auto numThreads = (denoise.numThreads > 0) ? denoise.numThreads : umath::max(std::thread::hardware_concurrency(), 1u);
+	auto numWorkers = umath::max(umath::min(umath::min(numThreads, std::thread::hardware_concurrency()), static_cast<uint32_t>(charts.size())), 1u);
+	auto numThreadsPerWorker = umath::max(numThreads / numWorkers, 1u);
+
+	// Every worker needs its own filter per bucket, since filters can't be used concurrently. Without the reservation they would
+	// evict each other from the filter cache of the DenoiseService.
+	auto &denoiseService = DenoiseService::GetInstance();
+	auto numReservedFilters = umath::min(numBuckets * numWorkers, ATLAS_MAX_RESERVED_FILTERS);
+	denoiseService.ReserveCachedFilters(numReservedFilters);
+
+	auto *imgData = static_cast<float *>(imgBuffer.GetData());
+	auto imgWidth = imgBuffer.GetWidth();
+	std::mutex progressMutex;
+	uint64_t processedArea = 0;
+	std::atomic<bool> cancelled = false;
+	std::atomic<bool> failed = false;
+	std::atomic<uint32_t> nextChart = 0;
+	auto processCharts = [&]() {
+		std::vector<float> regionData;
+		for(auto idx = nextChart++; idx < order.size() && !cancelled && !failed; idx = nextChart++) {
+			auto chartIdx = order[idx];
+			auto &chart = charts[chartIdx];
+			auto chartId = chartIdx + 1;
+			auto t = std::chrono::steady_clock::now();
+			// The padded bounds of the charts are disjoint, so every chart can read and write its region of the image without synchronization
+			fill_chart_region(imgData, imgWidth, chartMap, chartId, chart, regionData);
+			auto [bucketW, bucketH] = bucketSizes[chartIdx];
+			pad_chart_region(regionData, chart.w, chart.h, bucketW, bucketH);
+
+			auto chartInfo = denoise;
+			chartInfo.width = bucketW;
+			chartInfo.height = bucketH;
+			chartInfo.lightmap = true;
+			chartInfo.numThreads = numThreadsPerWorker;
+			ImageData regionImage {reinterpret_cast<uint8_t *>(regionData.data()), uimg::Format::RGB32};
+			ImageInputs inputs {};
+			inputs.beautyImage = regionImage;
+			if(!pragma::scenekit::denoise::denoise(chartInfo, inputs, regionImage, [&cancelled](float progress) -> bool { return !cancelled; })) {
+				failed = true;
+				break;
+			}
+
+			for(uint32_t y = 0; y < chart.h; ++y) {
+				for(uint32_t x = 0; x < chart.w; ++x) {
+					auto imgIdx = static_cast<size_t>(chart.y + y) * imgWidth + (chart.x + x);
+					if(chartMap[imgIdx] == chartId)
+						std::memcpy(imgData + imgIdx * 4, regionData.data() + (static_cast<size_t>(y) * bucketW + x) * 3, sizeof(float) * 3);
+				}
+			}
+			chart.denoiseTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count();
+
+			if(fProgressCallback) {
+				std::scoped_lock lock {progressMutex};
+				processedArea += static_cast<uint64_t>(chart.w) * chart.h;
+				if(!fProgressCallback(static_cast<float>(static_cast<double>(processedArea) / totalArea)))
+					cancelled = true;
+			}
+		}
+	};
+	std::vector<std::future<void>> workers;
+	workers.reserve(numWorkers - 1);
+	for(auto i = decltype(numWorkers) {1u}; i < numWorkers; ++i)
+		workers.push_back(std::async(std::launch::async, processCharts));
+	processCharts();
+	for(auto &worker : workers)
+		worker.wait();
+	denoiseService.ReleaseCachedFilterReservation(numReservedFilters);
+
+	if(optOutCharts)
+		*optOutCharts = std::move(charts);
+	return !cancelled && !failed;
+}
@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :post_processing_pool;
+
+pragma::scenekit::PostProcessingPool &pragma::scenekit::PostProcessingPool::GetInstance()
+{
+	static PostProcessingPool pool {};
+	return pool;
+}
+uint32_t pragma::scenekit::PostProcessingPool::GetDefaultConcurrency()
+{
+	auto n = std::thread::hardware_concurrency();
+	return (n > 0) ? n : 4;
+}
+
+pragma::scenekit::PostProcessingPool::PostProcessingPool() : m_concurrency {GetDefaultConcurrency()}, m_threadPool {static_cast<int32_t>(GetDefaultConcurrency())} {}
+
+void pragma::scenekit::PostProcessingPool::SetConcurrency(uint32_t concurrency)
+{
+	concurrency = umath::max(concurrency, 1u);
+	std::scoped_lock lock {m_mutex};
+	if(concurrency == m_concurrency)
+		return;
+	m_concurrency = concurrency;
+	m_threadPool.resize(static_cast<int32_t>(concurrency));
+}
+uint32_t pragma::scenekit::PostProcessingPool::GetConcurrency() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_concurrency;
+}
+
+void pragma::scenekit::PostProcessingPool::SetClientWeight(const TileManager &client, float weight)
+{
+	weight = umath::max(weight, 0.f);
+	std::scoped_lock lock {m_mutex};
+	auto &curWeight = m_clientWeights[&client];
+	m_totalWeight += weight - curWeight;
+	curWeight = weight;
+}
+void pragma::scenekit::PostProcessingPool::RemoveClient(const TileManager &client)
+{
+	std::scoped_lock lock {m_mutex};
+	auto it = m_clientWeights.find(&client);
+	if(it == m_clientWeights.end())
+		return;
+	m_totalWeight -= it->second;
+	m_clientWeights.erase(it);
+	if(m_clientWeights.empty())
+		m_totalWeight = 0.f; // Reset accumulated rounding errors
+}
+uint32_t pragma::scenekit::PostProcessingPool::GetWorkerBudget(const TileManager &client) const
+{
+	std::scoped_lock lock {m_mutex};
+	auto it = m_clientWeights.find(&client);
+	if(it == m_clientWeights.end() || m_totalWeight <= 0.f)
+		return m_concurrency;
+	// Every client gets at least one worker, regardless of its weight
+	auto budget = static_cast<uint32_t>(std::round(m_concurrency * (it->second / m_totalWeight)));
+	return umath::clamp(budget, 1u, m_concurrency);
+}
+
+std::future<void> pragma::scenekit::PostProcessingPool::Submit(const std::function<void()> &task)
+{
+	return m_threadPool.push([task](int threadId) { task(); });
+}
@@ -0,0 +1,131 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :preview_denoiser;
+
+// Sample milestones and preview requests are checked at least this often
+constexpr std::chrono::milliseconds PREVIEW_DENOISER_POLL_INTERVAL {100};
+
+pragma::scenekit::PreviewDenoiser::PreviewDenoiser(TileManager &tileManager) : m_tileManager {tileManager} {}
+
+pragma::scenekit::PreviewDenoiser::~PreviewDenoiser() { Stop(); }
+
+void pragma::scenekit::PreviewDenoiser::Start(const Settings &settings)
+{
+	Stop();
+	m_settings = settings;
+	m_stopping = false;
+	m_lastMilestone = 0;
+	m_thread = std::thread {[this]() { Run(); }};
+}
+
+void pragma::scenekit::PreviewDenoiser::Stop()
+{
+	if(!m_thread.joinable())
+		return;
+	m_mutex.lock();
+	m_stopping = true;
+	m_mutex.unlock();
+	m_condition.notify_one();
+	m_thread.join();
+}
+
+void pragma::scenekit::PreviewDenoiser::RequestPreview()
+{
+	m_mutex.lock();
+	++m_requestCounter;
+	m_mutex.unlock();
+	m_condition.notify_one();
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::PreviewDenoiser::GetPreview() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_preview;
+}
+
+void pragma::scenekit::PreviewDenoiser::SetPreviewCallback(const std::function<void(const std::shared_ptr<uimg::ImageBuffer> &)> &callback)
+{
+	std::scoped_lock lock {m_mutex};
+	m_previewCallback = callback;
+}
+
+uint32_t pragma::scenekit::PreviewDenoiser::GetLowestTileSampleCount() const
+{
+	auto numTiles = m_tileManager.GetTileCount();
+	if(numTiles == 0)
+		return 0;
+	auto lowest = std::numeric_limits<int32_t>::max();
+	for(auto i = decltype(numTiles) {0u}; i < numTiles; ++i)
+		lowest = umath::min(lowest, m_tileManager.GetCurrentTileSampleCount(i));
+	return static_cast<uint32_t>(umath::max(lowest, 0));
+}
+
+bool pragma::scenekit::PreviewDenoiser::IsMilestoneReached() const { return m_settings.sampleMilestone > 0 && GetLowestTileSampleCount() / m_settings.sampleMilestone > m_lastMilestone; }
+
+bool pragma::scenekit::PreviewDenoiser::IsJobStale(uint64_t request) const
+{
+	if(m_stopping)
+		return true;
+	// Only called from the denoising thread, which is the only one that updates the milestone
+	if(IsMilestoneReached())
+		return true;
+	return m_requestCounter != request;
+}
+
+void pragma::scenekit::PreviewDenoiser::Run()
+{
+	auto lastPreview = std::chrono::steady_clock::now();
+	uint64_t handledRequest = m_requestCounter;
+	std::unique_lock lock {m_mutex};
+	for(;;) {
+		m_condition.wait_for(lock, PREVIEW_DENOISER_POLL_INTERVAL, [this, handledRequest]() { return m_stopping || m_requestCounter != handledRequest; });
+		if(m_stopping)
+			break;
+		auto now = std::chrono::steady_clock::now();
+		auto due = (m_requestCounter != handledRequest) || (m_settings.interval.count() > 0 && now - lastPreview >= m_settings.interval);
+		lock.unlock();
+
+		if(IsMilestoneReached()) {
+			m_lastMilestone = GetLowestTileSampleCount() / m_settings.sampleMilestone;
+			due = true;
+		}
+		auto snapshot = (due && m_tileManager.GetTileCount() > 0) ? m_tileManager.GetFinalImageSnapshot() : nullptr;
+		if(!snapshot) {
+			lock.lock();
+			continue;
+		}
+		uint64_t request = m_requestCounter;
+		handledRequest = request;
+		lastPreview = now;
+
+		// The snapshot is read-only, so the preview is denoised in place on a copy. The copy also keeps the alpha channel.
+		auto preview = snapshot->Copy();
+		snapshot = nullptr; // Allows the tile manager to reuse the snapshot buffer
+		denoise::Info denoiseInfo {};
+		denoiseInfo.width = preview->GetWidth();
+		denoiseInfo.height = preview->GetHeight();
+		denoiseInfo.quality = m_settings.quality;
+		denoiseInfo.numThreads = m_settings.numThreads;
+		auto imgView = denoise::create_image_view(*preview);
+		denoise::ImageInputs inputs {};
+		inputs.beautyImage = imgView;
+		auto success = denoise::denoise(denoiseInfo, inputs, imgView, [this, request](float progress) -> bool { return !IsJobStale(request); });
+
+		lock.lock();
+		if(!success || m_stopping)
+			continue; // Cancelled, a newer snapshot will be picked up right away
+		m_preview = preview;
+		++m_previewVersion;
+		auto callback = m_previewCallback;
+		if(callback) {
+			lock.unlock();
+			callback(preview);
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,255 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import pragma.ocio;
+
+import :preview_pyramid;
+import :image_kernels;
+
+void pragma::scenekit::PreviewPyramid::Initialize(uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight, uint32_t numLevels, uimg::Format format, bool keepSourceTiles)
+{
+	std::unique_lock lock {m_mutex};
+	m_width = width;
+	m_height = height;
+	m_tileWidth = umath::max(tileWidth, 1u);
+	m_tileHeight = umath::max(tileHeight, 1u);
+	m_format = format;
+	m_keepSourceTiles = keepSourceTiles;
+	m_numTilesX = (width + m_tileWidth - 1) / m_tileWidth;
+	auto numTilesY = (height + m_tileHeight - 1) / m_tileHeight;
+	m_sourceTileMutex.lock();
+	m_sourceTiles.clear();
+	if(keepSourceTiles)
+		m_sourceTiles.resize(static_cast<size_t>(m_numTilesX) * numTilesY);
+	m_sourceTileMutex.unlock();
+	m_levels.clear();
+	m_levels.reserve(numLevels);
+	auto w = width;
+	auto h = height;
+	for(auto i = decltype(numLevels) {0u}; i < numLevels; ++i) {
+		if(w == 1 && h == 1)
+			break;
+		w = umath::max((w + 1) / 2, 1u);
+		h = umath::max((h + 1) / 2, 1u);
+		Level level {};
+		level.width = w;
+		level.height = h;
+		level.mutex = std::make_unique<std::mutex>();
+		level.linearData.resize(static_cast<size_t>(w) * h * 4, 0.f);
+		level.image = uimg::ImageBuffer::Create(w, h, format);
+		std::memset(level.image->GetData(), 0, level.image->GetSize());
+		m_levels.push_back(std::move(level));
+	}
+}
+
+void pragma::scenekit::PreviewPyramid::Clear()
+{
+	std::unique_lock lock {m_mutex};
+	m_sourceTileMutex.lock();
+	for(auto &tile : m_sourceTiles)
+		tile = {};
+	m_sourceTileMutex.unlock();
+	for(auto &level : m_levels) {
+		std::fill(level.linearData.begin(), level.linearData.end(), 0.f);
+		std::memset(level.image->GetData(), 0, level.image->GetSize());
+	}
+}
+
+uint32_t pragma::scenekit::PreviewPyramid::GetLevelCount() const
+{
+	std::shared_lock lock {m_mutex};
+	return m_levels.size();
+}
+
+uint32_t pragma::scenekit::PreviewPyramid::FindLevel(uint32_t width, uint32_t height) const
+{
+	std::shared_lock lock {m_mutex};
+	uint32_t result = 0;
+	for(uint32_t i = 0; i < m_levels.size(); ++i) {
+		auto &level = m_levels[i];
+		if(level.width < width || level.height < height)
+			break;
+		result = i + 1;
+	}
+	return result;
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::PreviewPyramid::GetLevel(uint32_t level) const
+{
+	std::shared_lock lock {m_mutex};
+	if(level == 0 || level > m_levels.size())
+		return nullptr;
+	auto &l = m_levels[level - 1];
+	std::scoped_lock levelLock {*l.mutex};
+	return l.image->Copy();
+}
+
+size_t pragma::scenekit::PreviewPyramid::GetTileGridIndex(uint32_t x, uint32_t y, bool flipHorizontally, bool flipVertically) const
+{
+	// The tile grid is aligned to the image origin before flipping
+	if(flipHorizontally)
+		x = m_width - 1 - x;
+	if(flipVertically)
+		y = m_height - 1 - y;
+	return static_cast<size_t>(y / m_tileHeight) * m_numTilesX + (x / m_tileWidth);
+}
+
+void pragma::scenekit::PreviewPyramid::RegionData::Reset(const Region &newRegion)
+{
+	region = newRegion;
+	auto numTexels = static_cast<size_t>(region.x1 - region.x0) * (region.y1 - region.y0);
+	texels.assign(numTexels * 4, 0.f);
+	valid.assign(numTexels, false);
+}
+
+void pragma::scenekit::PreviewPyramid::UpdateTile(const SourceTile &tile, bool flipHorizontally, bool flipVertically, pragma::ocio::ColorProcessor *optColorProcessor)
+{
+	std::shared_lock lock {m_mutex};
+	if(m_levels.empty() || tile.w == 0 || tile.h == 0 || tile.x + tile.w > m_width || tile.y + tile.h > m_height)
+		return;
+	if(tile.data.size() < static_cast<size_t>(tile.w) * tile.h * sizeof(float) * 4)
+		return;
+
+	// Texels on the tile border may also cover pixels of neighboring tiles. Only the handles of those tiles are copied, so the
+	// source tile lock is only held briefly.
+	std::vector<std::pair<size_t, SourceTile>> neighbors;
+	if(m_keepSourceTiles) {
+		auto tileGridIndex = GetTileGridIndex(tile.x, tile.y, flipHorizontally, flipVertically);
+		std::scoped_lock sourceTileLock {m_sourceTileMutex};
+		if(tileGridIndex < m_sourceTiles.size())
+			m_sourceTiles[tileGridIndex] = tile;
+		std::array<int64_t, 3> xs {static_cast<int64_t>(tile.x) - 1, tile.x, static_cast<int64_t>(tile.x) + tile.w};
+		std::array<int64_t, 3> ys {static_cast<int64_t>(tile.y) - 1, tile.y, static_cast<int64_t>(tile.y) + tile.h};
+		for(auto y : ys) {
+			for(auto x : xs) {
+				if(x < 0 || y < 0 || x >= m_width || y >= m_height)
+					continue;
+				auto idx = GetTileGridIndex(x, y, flipHorizontally, flipVertically);
+				if(idx == tileGridIndex || idx >= m_sourceTiles.size() || m_sourceTiles[idx].data.empty())
+					continue;
+				if(std::find_if(neighbors.begin(), neighbors.end(), [idx](const auto &pair) { return pair.first == idx; }) == neighbors.end())
+					neighbors.push_back({idx, m_sourceTiles[idx]});
+			}
+		}
+	}
+	auto getSourceTile = [&](uint32_t x, uint32_t y) -> const SourceTile * {
+		if(x >= tile.x && x < tile.x + tile.w && y >= tile.y && y < tile.y + tile.h)
+			return &tile;
+		for(auto &[idx, srcTile] : neighbors) {
+			if(x >= srcTile.x && x < srcTile.x + srcTile.w && y >= srcTile.y && y < srcTile.y + srcTile.h)
+				return &srcTile;
+		}
+		return nullptr;
+	};
+
+	// First level is filtered from the tile data
+	RegionData regionData {};
+	std::vector<float> transformBuffer;
+	auto &firstLevel = m_levels.front();
+	regionData.Reset({tile.x / 2u, tile.y / 2u, umath::min((tile.x + tile.w + 1u) / 2u, firstLevel.width), umath::min((tile.y + tile.h + 1u) / 2u, firstLevel.height)});
+	auto regionWidth = regionData.region.x1 - regionData.region.x0;
+	for(auto v = regionData.region.y0; v < regionData.region.y1; ++v) {
+		for(auto u = regionData.region.x0; u < regionData.region.x1; ++u) {
+			std::array<float, 4> sum {0.f, 0.f, 0.f, 0.f};
+			uint32_t count = 0;
+			for(auto y = v * 2; y < umath::min(v * 2 + 2, m_height); ++y) {
+				for(auto x = u * 2; x < umath::min(u * 2 + 2, m_width); ++x) {
+					auto *srcTile = getSourceTile(x, y);
+					if(!srcTile)
+						continue;
+					auto *px = reinterpret_cast<const float *>(srcTile->data.data()) + ((y - srcTile->y) * srcTile->w + (x - srcTile->x)) * 4;
+					for(uint8_t c = 0; c < 4; ++c)
+						sum[c] += px[c];
+					++count;
+				}
+			}
+			if(count == 0)
+				continue;
+			auto texelIdx = static_cast<size_t>(v - regionData.region.y0) * regionWidth + (u - regionData.region.x0);
+			for(uint8_t c = 0; c < 4; ++c)
+				regionData.texels[texelIdx * 4 + c] = sum[c] / count;
+			regionData.valid[texelIdx] = true;
+		}
+	}
+
+	// Every level is locked on its own. The next level is filtered while the lock of the current level is still held, so the
+	// current level can't change in the meantime, and the lock of the next level is acquired before the current one is released.
+	// This way concurrent updates can't overtake each other, so they're applied in the same order on all levels and an older
+	// update can't overwrite a newer one on a coarser level.
+	std::unique_lock levelLock {*m_levels.front().mutex};
+	for(size_t i = 0; i < m_levels.size(); ++i) {
+		auto &level = m_levels[i];
+		auto &region = regionData.region;
+		regionWidth = region.x1 - region.x0;
+		for(auto v = region.y0; v < region.y1; ++v) {
+			for(auto u = region.x0; u < region.x1; ++u) {
+				auto texelIdx = static_cast<size_t>(v - region.y0) * regionWidth + (u - region.x0);
+				if(!regionData.valid[texelIdx])
+					continue;
+				std::copy_n(regionData.texels.data() + texelIdx * 4, 4, level.linearData.data() + (static_cast<size_t>(v) * level.width + u) * 4);
+			}
+		}
+		UpdateImageRegion(level, region, optColorProcessor, transformBuffer);
+		if(i + 1 == m_levels.size())
+			break;
+
+		// Higher levels are filtered from the previous level
+		auto &nextLevel = m_levels[i + 1];
+		Region nextRegion {region.x0 / 2u, region.y0 / 2u, umath::min((region.x1 + 1u) / 2u, nextLevel.width), umath::min((region.y1 + 1u) / 2u, nextLevel.height)};
+		regionData.Reset(nextRegion);
+		auto nextRegionWidth = nextRegion.x1 - nextRegion.x0;
+		for(auto v = nextRegion.y0; v < nextRegion.y1; ++v) {
+			for(auto u = nextRegion.x0; u < nextRegion.x1; ++u) {
+				std::array<float, 4> sum {0.f, 0.f, 0.f, 0.f};
+				uint32_t count = 0;
+				for(auto y = v * 2; y < umath::min(v * 2 + 2, level.height); ++y) {
+					for(auto x = u * 2; x < umath::min(u * 2 + 2, level.width); ++x) {
+						auto *px = level.linearData.data() + (static_cast<size_t>(y) * level.width + x) * 4;
+						for(uint8_t c = 0; c < 4; ++c)
+							sum[c] += px[c];
+						++count;
+					}
+				}
+				auto texelIdx = static_cast<size_t>(v - nextRegion.y0) * nextRegionWidth + (u - nextRegion.x0);
+				for(uint8_t c = 0; c < 4; ++c)
+					regionData.texels[texelIdx * 4 + c] = sum[c] / count;
+				regionData.valid[texelIdx] = true;
+			}
+		}
+		levelLock = std::unique_lock {*nextLevel.mutex}; // Releases the lock of the current level
+	}
+}
+
+void pragma::scenekit::PreviewPyramid::UpdateImageRegion(Level &level, const Region &region, pragma::ocio::ColorProcessor *optColorProcessor, std::vector<float> &transformBuffer) const
+{
+	auto w = region.x1 - region.x0;
+	auto h = region.y1 - region.y0;
+	if(w == 0 || h == 0)
+		return;
+	auto rowValues = static_cast<size_t>(w) * 4;
+	transformBuffer.resize(rowValues * h);
+	for(uint32_t y = 0; y < h; ++y) {
+		auto *src = level.linearData.data() + (static_cast<size_t>(region.y0 + y) * level.width + region.x0) * 4;
+		std::copy(src, src + rowValues, transformBuffer.data() + y * rowValues);
+	}
+	if(optColorProcessor) {
+		auto img = uimg::ImageBuffer::Create(transformBuffer.data(), w, h, uimg::Format::RGBA_FLOAT);
+		std::string err;
+		if(optColorProcessor->Apply(*img, err) == false)
+			std::cout << "Unable to apply color transform to preview: " << err << std::endl;
+	}
+	auto pixelSize = uimg::ImageBuffer::GetPixelSize(m_format);
+	auto *dstData = static_cast<uint8_t *>(level.image->GetData());
+	for(uint32_t y = 0; y < h; ++y) {
+		auto *src = transformBuffer.data() + y * rowValues;
+		auto *dst = dstData + (static_cast<size_t>(region.y0 + y) * level.width + region.x0) * pixelSize;
+		if(m_format == uimg::Format::RGBA_HDR)
+			image_kernels::convert_f32_to_f16(src, reinterpret_cast<uint16_t *>(dst), rowValues);
+		else
+			std::memcpy(dst, src, rowValues * sizeof(float));
+	}
+}
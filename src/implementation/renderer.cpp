@@ -18,6 +18,7 @@ import :object;
 import :camera;
 import :light;
 import :shader;
+import :post_processing_pool;
 
 pragma::scenekit::RenderWorker::RenderWorker(Renderer &renderer) : util::ParallelWorker<uimg::ImageLayerSet> {}, m_renderer {renderer.shared_from_this()} {}
 void pragma::scenekit::RenderWorker::DoCancel(const std::string &resultMsg, std::optional<int32_t> resultCode)
@@ -131,8 +132,146 @@ std::shared_ptr<uimg::ImageBuffer> &pragma::scenekit::Renderer::GetResultImageBu
 		it = m_resultImageBuffers.insert(std::make_pair(type, std::array<std::shared_ptr<uimg::ImageBuffer>, umath::to_integral(StereoEye::Count)> {})).first;
 	return it->second.at(umath::to_integral(eye));
 }
+std::shared_ptr<uimg::ImageBuffer> &pragma::scenekit::Renderer::GetResultImageBuffer(PassType type, uint32_t width, uint32_t height, uimg::Format format, StereoEye eye)
+{
+	auto &imgBuf = GetResultImageBuffer(type, eye);
+	if(imgBuf && imgBuf.use_count() == 1 && imgBuf->GetWidth() == width && imgBuf->GetHeight() == height && imgBuf->GetFormat() == format)
+		return imgBuf;
+	imgBuf = ImageBufferPool::GetInstance().Acquire(width, height, format);
+	return imgBuf;
+}
+void pragma::scenekit::Renderer::ReleaseResultImageBuffers()
+{
+	ReleaseStereoCompositeImage();
+	m_resultImageBuffers.clear();
+}
 
 void pragma::scenekit::Renderer::UpdateActorMap() { m_actorMap = m_scene->BuildActorMap(); }
+void pragma::scenekit::Renderer::AllocateStereoCompositeImage(PassType type, uint32_t width, uint32_t height, uimg::Format format)
+{
+	ReleaseStereoCompositeImage();
+	// The left eye occupies the top half and the right eye the bottom half
+	auto composite = ImageBufferPool::GetInstance().Acquire(width, height * 2, format);
+	auto *data = static_cast<uint8_t *>(composite->GetData());
+	auto eyeSize = static_cast<size_t>(width) * height * uimg::ImageBuffer::GetPixelSize(format);
+	auto createEyeView = [&composite, width, height, format](uint8_t *eyeData) -> std::shared_ptr<uimg::ImageBuffer> {
+		// The view doesn't own its data, so it keeps a reference to the composite, which may be released before the view
+		// (e.g. by a pending denoising job)
+		auto view = uimg::ImageBuffer::Create(eyeData, width, height, format);
+		return std::shared_ptr<uimg::ImageBuffer> {view.get(), [view, composite](uimg::ImageBuffer *) {}};
+	};
+	GetResultImageBuffer(type, StereoEye::Left) = createEyeView(data);
+	GetResultImageBuffer(type, StereoEye::Right) = createEyeView(data + eyeSize);
+	// Only the eye views own the composite, so it's returned to the pool as soon as the renderer replaces them
+	m_stereoCompositeImage = composite;
+}
+void pragma::scenekit::Renderer::ReleaseStereoCompositeImage()
+{
+	auto composite = m_stereoCompositeImage.lock();
+	m_stereoCompositeImage.reset();
+	if(!composite)
+		return;
+	// Eye views that are still set would otherwise keep the composite alive
+	auto *data = static_cast<uint8_t *>(composite->GetData());
+	auto *dataEnd = data + composite->GetSize();
+	for(auto &[type, imgBufs] : m_resultImageBuffers) {
+		for(auto &imgBuf : imgBufs) {
+			if(!imgBuf || imgBuf == composite)
+				continue;
+			auto *imgData = static_cast<uint8_t *>(imgBuf->GetData());
+			if(imgData >= data && imgData < dataEnd)
+				imgBuf = nullptr;
+		}
+	}
+}
+bool pragma::scenekit::Renderer::ShouldDenoiseStereoEyesConcurrently() const
+{
+	// Denoising runs on the CPU, so it would only compete with a CPU render device for the same threads. It also takes up a
+	// thread that would otherwise be available to the tile workers, so the renderer needs a share of at least two pool workers.
+	if(m_tileManager.IsCpuDevice())
+		return false;
+	return PostProcessingPool::GetInstance().GetWorkerBudget(m_tileManager) >= 2;
+}
+void pragma::scenekit::Renderer::WaitForStereoEyeDenoising()
+{
+	if(m_stereoEyeDenoiseJob.valid())
+		m_stereoEyeDenoiseJob.get();
+}
+void pragma::scenekit::Renderer::FinalizeResultImages(StereoEye eyeStage)
+{
+	auto t = LatencyHistogram::GetTimestamp();
+	// Passes are sorted so that the debug dumps are always written in the same order
+	std::vector<std::pair<PassType, uimg::ImageBuffer *>> images;
+	images.reserve(m_resultImageBuffers.size());
+	for(auto &pair : m_resultImageBuffers) {
+		auto &resultImageBuffer = pair.second[umath::to_integral((eyeStage != StereoEye::None) ? eyeStage : StereoEye::Left)];
+		if(resultImageBuffer)
+			images.push_back({pair.first, resultImageBuffer.get()});
+	}
+	std::sort(images.begin(), images.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+	struct FinalizeResult {
+		std::string error;
+		// Copies of the intermediate images, only if render stage images are dumped
+		std::shared_ptr<uimg::ImageBuffer> rawOutput = nullptr;
+		std::shared_ptr<uimg::ImageBuffer> colorTransform = nullptr;
+		std::shared_ptr<uimg::ImageBuffer> alpha = nullptr;
+	};
+	std::vector<FinalizeResult> results {images.size()};
+	auto dumpImages = ShouldDumpRenderStageImages();
+	auto clearAlpha = !ShouldUseTransparentSky() || pragma::scenekit::Scene::IsLightmapRenderMode(m_scene->GetRenderMode());
+	auto finalize = [this, eyeStage, dumpImages, clearAlpha](uimg::ImageBuffer &imgBuf, FinalizeResult &result) {
+		if(dumpImages)
+			result.rawOutput = imgBuf.Copy();
+		if(m_colorTransformProcessor) // TODO: Should we really apply color transform if we're not denoising?
+		{
+			std::string err;
+			if(m_colorTransformProcessor->Apply(imgBuf, err) == false)
+				result.error = "Unable to apply color transform: " + err;
+			if(dumpImages)
+				result.colorTransform = imgBuf.Copy();
+		}
+		if(clearAlpha)
+			imgBuf.ClearAlpha();
+		if(dumpImages)
+			result.alpha = imgBuf.Copy();
+		FinalizeImage(imgBuf, eyeStage);
+	};
+
+	// Errors are reported and the copies are dumped (and released) as soon as the pass has been finalized
+	auto flushResult = [this](FinalizeResult &result) {
+		if(!result.error.empty())
+			m_scene->HandleError(result.error);
+		if(result.rawOutput)
+			DumpImage("raw_output", std::move(result.rawOutput), uimg::ImageFormat::PNG);
+		if(result.colorTransform)
+			DumpImage("color_transform", std::move(result.colorTransform), uimg::ImageFormat::HDR);
+		if(result.alpha)
+			DumpImage("alpha", std::move(result.alpha), uimg::ImageFormat::HDR);
+	};
+
+	auto serial = false;
+	GetApiData().GetFromPath("debug/finalizeImagesSerially")(serial);
+	if(serial || images.size() < 2 || !IsFinalizeImageThreadSafe()) {
+		for(size_t i = 0; i < images.size(); ++i) {
+			finalize(*images[i].second, results[i]);
+			flushResult(results[i]);
+		}
+	}
+	else {
+		std::vector<std::future<void>> jobs;
+		jobs.reserve(images.size());
+		for(size_t i = 0; i < images.size(); ++i)
+			jobs.push_back(PostProcessingPool::GetInstance().Submit([&finalize, &images, &results, i]() { finalize(*images[i].second, results[i]); }));
+		// The jobs are waited for in pass order, so the dumps are still written in the same order
+		for(size_t i = 0; i < jobs.size(); ++i) {
+			jobs[i].get();
+			flushResult(results[i]);
+		}
+	}
+
+	m_finalizeImageLatency.Record(LatencyHistogram::GetTimestamp() - t);
+}
 bool pragma::scenekit::Renderer::IsFeatureEnabled(Feature feature) const { return false; }
 
 pragma::scenekit::Renderer::RenderStageResult pragma::scenekit::Renderer::StartNextRenderStage(RenderWorker &worker, pragma::scenekit::Renderer::ImageRenderStage stage, StereoEye eyeStage)
@@ -141,19 +280,17 @@ pragma::scenekit::Renderer::RenderStageResult pragma::scenekit::Renderer::StartN
 	auto handled = HandleRenderStage(worker, stage, eyeStage, &result);
 	return result;
 }
+static std::string get_dump_file_name(const std::string &renderStage, uimg::ImageFormat format, const std::optional<std::string> &fileNameOverride)
+{
+	return fileNameOverride.has_value() ? *fileNameOverride : ("temp/render_image_stages/render_output_" + renderStage + "." + uimg::get_file_extension(format));
+}
 void pragma::scenekit::Renderer::DumpImage(const std::string &renderStage, uimg::ImageBuffer &imgBuffer, uimg::ImageFormat format, const std::optional<std::string> &fileNameOverride) const
 {
-	filemanager::create_path("temp/render_image_stages");
-	auto fileName = fileNameOverride.has_value() ? *fileNameOverride : ("temp/render_image_stages/render_output_" + renderStage + "." + uimg::get_file_extension(format));
-	auto f = filemanager::open_file(fileName, filemanager::FileMode::Write | filemanager::FileMode::Binary);
-	if(!f) {
-		std::cout << "Failed to dump render stage image '" << renderStage << "': Could not open file '" << fileName << "' for writing!" << std::endl;
-		return;
-	}
-	fsys::File fp {f};
-	auto res = uimg::save_image(fp, imgBuffer, format);
-	if(!res)
-		std::cout << "Failed to dump render stage image '" << renderStage << "': Unknown error!" << std::endl;
+	m_imageDumpWriter.Write(get_dump_file_name(renderStage, format, fileNameOverride), imgBuffer, format);
+}
+void pragma::scenekit::Renderer::DumpImage(const std::string &renderStage, std::shared_ptr<uimg::ImageBuffer> &&snapshot, uimg::ImageFormat format, const std::optional<std::string> &fileNameOverride) const
+{
+	m_imageDumpWriter.Write(get_dump_file_name(renderStage, format, fileNameOverride), std::move(snapshot), format);
 }
 bool pragma::scenekit::Renderer::ShouldDumpRenderStageImages() const
 {
@@ -167,24 +304,37 @@ util::EventReply pragma::scenekit::Renderer::HandleRenderStage(RenderWorker &wor
 	switch(stage) {
 	case ImageRenderStage::Denoise:
 		{
-			auto denoiseImg = [this, eyeStage, &worker](uimg::ImageBuffer &imgBuf, bool lightmap) {
-				auto albedoImageBuffer = GetResultImageBuffer(PassType::Albedo, eyeStage);
-				auto normalImageBuffer = GetResultImageBuffer(PassType::Normals, eyeStage);
-
+			// The final image takes precedence over the preview
+			StopPreviewDenoising();
+			auto denoiseImg = [this, &worker](uimg::ImageBuffer &imgBuf, uimg::ImageBuffer *albedoImageBuffer, uimg::ImageBuffer *normalImageBuffer, bool lightmap) {
 				denoise::Info denoiseInfo {};
 				denoiseInfo.width = imgBuf.GetWidth();
 				denoiseInfo.height = imgBuf.GetHeight();
 				denoiseInfo.lightmap = lightmap;
-				denoise::denoise(denoiseInfo, imgBuf, albedoImageBuffer.get(), normalImageBuffer.get(), [this, &worker](float progress) -> bool { return !worker.IsCancelled(); });
+				denoiseInfo.quality = m_scene->GetDenoiseQuality();
+				denoise::denoise(denoiseInfo, imgBuf, albedoImageBuffer, normalImageBuffer, [this, &worker](float progress) -> bool { return !worker.IsCancelled(); });
+			};
+			// Lightmap atlases are denoised per chart, so unoccupied texels don't bleed into the charts
+			auto denoiseAtlas = [this, &worker](PassType passType, uimg::ImageBuffer &imgBuf) {
+				denoise::Info denoiseInfo {};
+				denoiseInfo.quality = m_scene->GetDenoiseQuality();
+				std::vector<denoise::AtlasChart> charts;
+				denoise::denoise_atlas(denoiseInfo, imgBuf, &charts, [this, &worker](float progress) -> bool { return !worker.IsCancelled(); });
+				std::scoped_lock lock {m_lightmapDenoiseStatsMutex};
+				m_lightmapDenoiseStats[passType] = std::move(charts);
 			};
 			if(Scene::IsLightmapRenderMode(m_scene->GetRenderMode())) {
+				{
+					std::scoped_lock lock {m_lightmapDenoiseStatsMutex};
+					m_lightmapDenoiseStats.clear();
+				}
 				switch(m_scene->GetRenderMode()) {
 				case Scene::RenderMode::BakeDiffuseLighting:
-					denoiseImg(*GetResultImageBuffer(PassType::Diffuse, eyeStage), true);
+					denoiseAtlas(PassType::Diffuse, *GetResultImageBuffer(PassType::Diffuse, eyeStage));
 					break;
 				case Scene::RenderMode::BakeDiffuseLightingSeparate:
-					denoiseImg(*GetResultImageBuffer(PassType::DiffuseDirect, eyeStage), true);
-					denoiseImg(*GetResultImageBuffer(PassType::DiffuseIndirect, eyeStage), true);
+					denoiseAtlas(PassType::DiffuseDirect, *GetResultImageBuffer(PassType::DiffuseDirect, eyeStage));
+					denoiseAtlas(PassType::DiffuseIndirect, *GetResultImageBuffer(PassType::DiffuseIndirect, eyeStage));
 					break;
 				}
 			}
@@ -200,8 +350,39 @@ util::EventReply pragma::scenekit::Renderer::HandleRenderStage(RenderWorker &wor
 						resultImageBuffer = GetResultImageBuffer(PassType::Albedo, eyeStage);
 					else if(dbgNormals)
 						resultImageBuffer = GetResultImageBuffer(PassType::Normals, eyeStage);
+					else if(m_temporalDenoiser && eyeStage == StereoEye::None) {
+						auto &cam = m_scene->GetCamera();
+						denoise::TemporalDenoiser::CameraInfo camInfo {};
+						camInfo.pose = cam.GetPose();
+						camInfo.fov = cam.GetFov();
+						camInfo.perspective = (cam.GetType() == Camera::CameraType::Perspective);
+						denoise::TemporalDenoiser::FrameInputs inputs {};
+						inputs.color = resultImageBuffer.get();
+						inputs.albedo = FindResultImageBuffer(PassType::Albedo, eyeStage);
+						inputs.normal = FindResultImageBuffer(PassType::Normals, eyeStage);
+						inputs.position = FindResultImageBuffer(PassType::Position, eyeStage);
+						inputs.depth = FindResultImageBuffer(PassType::Depth, eyeStage);
+						denoise::Info denoiseInfo {};
+						denoiseInfo.quality = m_scene->GetDenoiseQuality();
+						m_temporalDenoiser->Denoise(denoiseInfo, camInfo, inputs, [this, &worker](float progress) -> bool { return !worker.IsCancelled(); });
+						if(ShouldDumpRenderStageImages())
+							DumpImage("denoise", *resultImageBuffer, uimg::ImageFormat::HDR);
+					}
+					else if(eyeStage == StereoEye::Left && ShouldDenoiseStereoEyesConcurrently()) {
+						// The left eye is denoised while the right eye is being rendered. The job only works on the buffers
+						// it has been given, so it doesn't have to synchronize with the render stages of the right eye.
+						std::shared_ptr<uimg::ImageBuffer> imgBuf = resultImageBuffer;
+						std::shared_ptr<uimg::ImageBuffer> albedoImageBuffer = GetResultImageBuffer(PassType::Albedo, eyeStage);
+						std::shared_ptr<uimg::ImageBuffer> normalImageBuffer = GetResultImageBuffer(PassType::Normals, eyeStage);
+						auto dumpImage = ShouldDumpRenderStageImages();
+						m_stereoEyeDenoiseJob = std::async(std::launch::async, [this, denoiseImg, imgBuf, albedoImageBuffer, normalImageBuffer, dumpImage]() {
+							denoiseImg(*imgBuf, albedoImageBuffer.get(), normalImageBuffer.get(), false);
+							if(dumpImage)
+								DumpImage("denoise", *imgBuf, uimg::ImageFormat::HDR);
+						});
+					}
 					else {
-						denoiseImg(*resultImageBuffer, false);
+						denoiseImg(*resultImageBuffer, GetResultImageBuffer(PassType::Albedo, eyeStage).get(), GetResultImageBuffer(PassType::Normals, eyeStage).get(), false);
 						if(ShouldDumpRenderStageImages())
 							DumpImage("denoise", *resultImageBuffer, uimg::ImageFormat::HDR);
 					}
@@ -218,26 +399,9 @@ util::EventReply pragma::scenekit::Renderer::HandleRenderStage(RenderWorker &wor
 		}
 	case ImageRenderStage::FinalizeImage:
 		{
-			for(auto &pair : m_resultImageBuffers) {
-				auto &resultImageBuffer = pair.second[umath::to_integral((eyeStage != StereoEye::None) ? eyeStage : StereoEye::Left)];
-				if(!resultImageBuffer)
-					continue;
-				if(ShouldDumpRenderStageImages())
-					DumpImage("raw_output", *resultImageBuffer, uimg::ImageFormat::PNG);
-				if(m_colorTransformProcessor) // TODO: Should we really apply color transform if we're not denoising?
-				{
-					std::string err;
-					if(m_colorTransformProcessor->Apply(*resultImageBuffer, err) == false)
-						m_scene->HandleError("Unable to apply color transform: " + err);
-					if(ShouldDumpRenderStageImages())
-						DumpImage("color_transform", *resultImageBuffer, uimg::ImageFormat::HDR);
-				}
-				if(!ShouldUseTransparentSky() || pragma::scenekit::Scene::IsLightmapRenderMode(m_scene->GetRenderMode()))
-					resultImageBuffer->ClearAlpha();
-				if(ShouldDumpRenderStageImages())
-					DumpImage("alpha", *resultImageBuffer, uimg::ImageFormat::HDR);
-				FinalizeImage(*resultImageBuffer, eyeStage);
-			}
+			if(eyeStage == StereoEye::Left)
+				WaitForStereoEyeDenoising();
+			FinalizeResultImages(eyeStage);
 			if(eyeStage == StereoEye::Left) {
 				if(optResult)
 					*optResult = RenderStageResult::Continue;
@@ -249,25 +413,39 @@ util::EventReply pragma::scenekit::Renderer::HandleRenderStage(RenderWorker &wor
 		}
 	case ImageRenderStage::MergeStereoscopic:
 		{
+			WaitForStereoEyeDenoising();
 			auto passType = get_main_pass_type(m_scene->GetRenderMode());
 			if(passType.has_value()) {
 				auto &imgLeft = GetResultImageBuffer(*passType, StereoEye::Left);
 				auto &imgRight = GetResultImageBuffer(*passType, StereoEye::Right);
-				auto w = imgLeft->GetWidth();
-				auto h = imgLeft->GetHeight();
-				auto imgComposite = uimg::ImageBuffer::Create(w, h * 2, imgLeft->GetFormat());
-				auto *dataSrcLeft = imgLeft->GetData();
-				auto *dataSrcRight = imgRight->GetData();
-				auto *dataDst = imgComposite->GetData();
-				memcpy(dataDst, dataSrcLeft, imgLeft->GetSize());
-				memcpy(static_cast<uint8_t *>(dataDst) + imgLeft->GetSize(), dataSrcRight, imgRight->GetSize());
-				imgLeft = imgComposite;
-				imgRight = nullptr;
+				auto composite = m_stereoCompositeImage.lock();
+				if(composite && imgLeft && imgRight && imgLeft->GetData() == composite->GetData() && imgRight->GetData() == static_cast<uint8_t *>(composite->GetData()) + imgLeft->GetSize()) {
+					// Both eyes have been rendered into their halves of the composite image, so there's nothing to copy
+					imgLeft = composite;
+					imgRight = nullptr;
+				}
+				else {
+					auto w = imgLeft->GetWidth();
+					auto h = imgLeft->GetHeight();
+					auto imgComposite = ImageBufferPool::GetInstance().Acquire(w, h * 2, imgLeft->GetFormat());
+					auto *dataSrcLeft = imgLeft->GetData();
+					auto *dataSrcRight = imgRight->GetData();
+					auto *dataDst = imgComposite->GetData();
+					memcpy(dataDst, dataSrcLeft, imgLeft->GetSize());
+					memcpy(static_cast<uint8_t *>(dataDst) + imgLeft->GetSize(), dataSrcRight, imgRight->GetSize());
+					imgLeft = imgComposite;
+					imgRight = nullptr;
+				}
+				composite = nullptr;
+				ReleaseStereoCompositeImage();
 			}
 			return HandleRenderStage(worker, ImageRenderStage::Finalize, StereoEye::None, optResult);
 		}
 	case ImageRenderStage::Finalize:
 		// We're done here
+		WaitForStereoEyeDenoising();
+		if(m_tileManager.IsStreamingOutputEnabled())
+			m_tileManager.FinalizeStreamingOutput();
 		CloseRenderScene();
 		if(optResult)
 			*optResult = RenderStageResult::Complete;
@@ -277,13 +455,42 @@ util::EventReply pragma::scenekit::Renderer::HandleRenderStage(RenderWorker &wor
 }
 void pragma::scenekit::Renderer::PrepareCyclesSceneForRendering()
 {
+	// The buffers of the previous render are returned to the pool, unless they're still referenced elsewhere
+	ReleaseResultImageBuffers();
 	m_tileManager.SetUseFloatData(ShouldUseProgressiveFloatFormat());
+	auto instrumentTilePipeline = false;
+	GetApiData().GetFromPath("debug/instrumentTilePipeline")(instrumentTilePipeline);
+	m_tileManager.SetInstrumentationEnabled(instrumentTilePipeline);
+	m_tileManager.ResetInstrumentation();
+	// Streams completed tiles into a raw image file instead of keeping them in memory (see TileManager::SetStreamingOutput)
+	std::string streamingOutput;
+	uint32_t streamingMaxPendingTiles = 32;
+	GetApiData().GetFromPath("streamingOutput/fileName")(streamingOutput);
+	GetApiData().GetFromPath("streamingOutput/maxPendingTiles")(streamingMaxPendingTiles);
+	m_tileManager.SetStreamingOutput(streamingOutput, streamingMaxPendingTiles);
+	auto &sceneInfo = m_scene->GetSceneInfo();
+	if(sceneInfo.useAdaptiveSampling)
+		m_tileManager.SetConvergenceThreshold(sceneInfo.adaptiveSamplingThreshold, sceneInfo.adaptiveMinSamples);
+	else
+		m_tileManager.SetConvergenceThreshold(0.f);
 	m_renderData.shaderCache = ShaderCache::Create();
 	m_renderData.modelCache = ModelCache::Create();
 
 	for(auto &mdlCache : m_scene->GetModelCaches())
 		m_renderData.modelCache->Merge(*mdlCache);
 	m_renderData.modelCache->Bake();
+	UpdateLookupTables();
+
+	auto &cam = m_scene->GetCamera();
+	// The temporal denoiser needs the depth pass to reproject the history (unless the position pass is rendered anyway)
+	if(m_temporalDenoiser && !cam.IsStereoscopic() && m_passes.find(PassType::Position) == m_passes.end())
+		AddPass(PassType::Depth);
+	if(cam.IsStereoscopic()) {
+		auto passType = get_main_pass_type(m_scene->GetRenderMode());
+		auto compositeFormat = passType.has_value() ? GetStereoCompositeFormat(*passType) : std::optional<uimg::Format> {};
+		if(compositeFormat.has_value())
+			AllocateStereoCompositeImage(*passType, cam.GetWidth(), cam.GetHeight(), *compositeFormat);
+	}
 
 	m_scene->PrintLogInfo();
 }
@@ -312,14 +519,11 @@ pragma::scenekit::WorldObject *pragma::scenekit::Renderer::FindActor(const util:
 }
 pragma::scenekit::PMesh pragma::scenekit::Renderer::FindRenderMeshByHash(const util::MurmurHash3 &hash) const
 {
-	// TODO: Do this via a lookup table
-	for(auto &chunk : m_renderData.modelCache->GetChunks()) {
-		for(auto &mesh : chunk.GetMeshes()) {
-			if(mesh->GetHash() == hash)
-				return mesh;
-		}
-	}
-	return nullptr;
+	std::shared_lock lock {m_lookupTableMutex};
+	auto it = m_meshHashMap.find(hash);
+	if(it == m_meshHashMap.end())
+		return nullptr;
+	return it->second;
 }
 void pragma::scenekit::Renderer::StopRendering()
 {
@@ -328,13 +532,40 @@ void pragma::scenekit::Renderer::StopRendering()
 }
 pragma::scenekit::Object *pragma::scenekit::Renderer::FindObject(const std::string &objectName) const
 {
+	std::shared_lock lock {m_lookupTableMutex};
+	auto it = m_objectNameMap.find(objectName);
+	if(it == m_objectNameMap.end())
+		return nullptr;
+	return it->second;
+}
+void pragma::scenekit::Renderer::UpdateLookupTables()
+{
+	std::unique_lock lock {m_lookupTableMutex};
+	m_meshHashMap.clear();
+	m_objectNameMap.clear();
+	if(!m_renderData.modelCache)
+		return;
+	size_t numMeshes = 0;
+	size_t numObjects = 0;
 	for(auto &chunk : m_renderData.modelCache->GetChunks()) {
-		for(auto &obj : chunk.GetObjects()) {
-			if(obj->GetName() == objectName)
-				return obj.get();
-		}
+		numMeshes += chunk.GetMeshes().size();
+		numObjects += chunk.GetObjects().size();
 	}
-	return nullptr;
+	m_meshHashMap.reserve(numMeshes);
+	m_objectNameMap.reserve(numObjects);
+	for(auto &chunk : m_renderData.modelCache->GetChunks()) {
+		for(auto &mesh : chunk.GetMeshes())
+			m_meshHashMap.emplace(mesh->GetHash(), mesh);
+		for(auto &obj : chunk.GetObjects())
+			m_objectNameMap.emplace(obj->GetName(), obj.get());
+	}
+}
+void pragma::scenekit::Renderer::AddToLookupTables(Object &obj)
+{
+	std::unique_lock lock {m_lookupTableMutex};
+	m_objectNameMap.emplace(obj.GetName(), &obj);
+	auto &mesh = obj.GetMesh();
+	m_meshHashMap.emplace(mesh.GetHash(), mesh.shared_from_this());
 }
 void pragma::scenekit::Renderer::OnParallelWorkerCancelled()
 {
@@ -343,7 +574,74 @@ void pragma::scenekit::Renderer::OnParallelWorkerCancelled()
 	// StopRendering();
 }
 std::vector<pragma::scenekit::TileManager::TileData> pragma::scenekit::Renderer::GetRenderedTileBatch() { return m_tileManager.GetRenderedTileBatch(); }
-void pragma::scenekit::Renderer::AddActorToActorMap(WorldObject &obj) { Scene::AddActorToActorMap(m_actorMap, obj); }
+const std::vector<pragma::scenekit::TileManager::TileData> &pragma::scenekit::Renderer::PollRenderedTiles() { return m_tileManager.PollRenderedTiles(); }
+void pragma::scenekit::Renderer::SetTileSchedulingPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest) { m_tileManager.SetTileSchedulingPolicy(policy, regionOfInterest); }
+pragma::scenekit::TileSchedulingPolicy pragma::scenekit::Renderer::GetTileSchedulingPolicy() const { return m_tileManager.GetTileSchedulingPolicy(); }
+static void write_latency_histogram(udm::LinkedPropertyWrapper &udmStage, const pragma::scenekit::LatencyHistogram &histogram)
+{
+	// All durations are in nanoseconds
+	udmStage["count"] = histogram.GetCount();
+	udmStage["mean"] = histogram.GetMean();
+	udmStage["max"] = histogram.GetMax();
+	udmStage["p50"] = histogram.GetPercentile(0.5);
+	udmStage["p90"] = histogram.GetPercentile(0.9);
+	udmStage["p99"] = histogram.GetPercentile(0.99);
+	std::vector<uint64_t> buckets(pragma::scenekit::LatencyHistogram::BUCKET_COUNT);
+	for(uint32_t j = 0; j < buckets.size(); ++j)
+		buckets[j] = histogram.GetBucketCount(j);
+	udmStage["buckets"] = buckets;
+}
+void pragma::scenekit::Renderer::GetTilePipelineStats(udm::LinkedPropertyWrapper &outData) const
+{
+	outData["enabled"] = m_tileManager.IsInstrumentationEnabled();
+	for(auto i = decltype(umath::to_integral(TileManager::PipelineStage::Count)) {0u}; i < umath::to_integral(TileManager::PipelineStage::Count); ++i) {
+		auto stage = static_cast<TileManager::PipelineStage>(i);
+		auto udmStage = outData[std::string {magic_enum::enum_name(stage)}];
+		write_latency_histogram(udmStage, m_tileManager.GetStageLatency(stage));
+	}
+}
+void pragma::scenekit::Renderer::ResetTilePipelineStats() { m_tileManager.ResetInstrumentation(); }
+void pragma::scenekit::Renderer::GetFinalizeImageStats(udm::LinkedPropertyWrapper &outData) const
+{
+	auto serial = false;
+	GetApiData().GetFromPath("debug/finalizeImagesSerially")(serial);
+	outData["serial"] = serial || !IsFinalizeImageThreadSafe();
+	write_latency_histogram(outData, m_finalizeImageLatency);
+}
+void pragma::scenekit::Renderer::ResetFinalizeImageStats() { m_finalizeImageLatency.Reset(); }
+void pragma::scenekit::Renderer::StartPreviewDenoising(const PreviewDenoiser::Settings &settings) { m_previewDenoiser.Start(settings); }
+void pragma::scenekit::Renderer::StopPreviewDenoising() { m_previewDenoiser.Stop(); }
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::Renderer::GetDenoisedPreview() const { return m_previewDenoiser.GetPreview(); }
+uint64_t pragma::scenekit::Renderer::GetDenoisedPreviewVersion() const { return m_previewDenoiser.GetPreviewVersion(); }
+void pragma::scenekit::Renderer::GetLightmapDenoiseStats(udm::LinkedPropertyWrapper &outData) const
+{
+	std::scoped_lock lock {m_lightmapDenoiseStatsMutex};
+	for(auto &[passType, charts] : m_lightmapDenoiseStats) {
+		auto udmPass = outData[std::string {magic_enum::enum_name(passType)}];
+		uint64_t totalTime = 0;
+		auto udmCharts = udmPass.AddArray("charts", charts.size());
+		for(size_t i = 0; i < charts.size(); ++i) {
+			auto &chart = charts[i];
+			auto udmChart = udmCharts[i];
+			udmChart["x"] = chart.x;
+			udmChart["y"] = chart.y;
+			udmChart["w"] = chart.w;
+			udmChart["h"] = chart.h;
+			udmChart["texels"] = chart.numTexels;
+			udmChart["time"] = chart.denoiseTime;
+			totalTime += chart.denoiseTime;
+		}
+		udmPass["totalTime"] = totalTime;
+	}
+}
+void pragma::scenekit::Renderer::AddActorToActorMap(WorldObject &obj)
+{
+	Scene::AddActorToActorMap(m_actorMap, obj);
+	// Live actors are registered through here, so the lookup tables have to be kept in sync
+	auto *o = dynamic_cast<Object *>(&obj);
+	if(o)
+		AddToLookupTables(*o);
+}
 bool pragma::scenekit::Renderer::Initialize()
 {
 	m_scene->GetCamera().Finalize(*m_scene);
@@ -358,6 +656,8 @@ bool pragma::scenekit::Renderer::Initialize()
 		for(auto &o : chunk.GetMeshes())
 			o->Finalize(*m_scene);
 	}
+	// Generating the data may have changed the chunks
+	UpdateLookupTables();
 	for(auto &shader : m_renderData.shaderCache->GetShaders())
 		shader->Finalize();
 	return true;
@@ -286,6 +286,17 @@ static void shrink_area_to_fit(const float *inOutImgData, uint32_t imgWidth, uin
 		--w;
 }
 
+pragma::scenekit::denoise::Quality pragma::scenekit::Scene::GetDenoiseQuality() const
+{
+	switch(GetDenoiseMode()) {
+	case DenoiseMode::AutoFast:
+		return denoise::Quality::Fast;
+	case DenoiseMode::AutoDetailed:
+		return denoise::Quality::High;
+	default:
+		return denoise::Quality::Default;
+	}
+}
 void pragma::scenekit::Scene::DenoiseHDRImageArea(uimg::ImageBuffer &imgBuffer, uint32_t imgWidth, uint32_t imgHeight, uint32_t xOffset, uint32_t yOffset, uint32_t w, uint32_t h) const
 {
 	// In some cases the borders may not contain any image data (i.e. fully transparent) if the pixels are not actually
@@ -336,56 +347,18 @@ void pragma::scenekit::Scene::DenoiseHDRImageArea(uimg::ImageBuffer &imgBuffer,
 	}
 	}*/
 
-	std::vector<float> imgAreaData {};
-	imgAreaData.resize(w * h * 3);
-	// Extract the area from the image data
-	for(auto y = decltype(h) {0u}; y < h; ++y) {
-		for(auto x = decltype(w) {0u}; x < w; ++x) {
-			auto srcPxIdx = pxStartOffset + y * imgWidth + x;
-			auto dstPxIdx = y * w + x;
-			for(uint8_t i = 0; i < 3; ++i)
-				imgAreaData.at(dstPxIdx * 3 + i) = imgData[srcPxIdx * 4 + i];
-		}
-	}
-
-	// Denoise the extracted area
+	// Denoise the area in place, the view skips the alpha channel and the pixels outside of the area
 	denoise::Info denoiseInfo {};
 	denoiseInfo.width = w;
 	denoiseInfo.height = h;
+	denoiseInfo.quality = GetDenoiseQuality();
 
-	denoise::ImageData denoiseImgData {};
-	denoiseImgData.data = reinterpret_cast<uint8_t *>(imgAreaData.data());
-	denoiseImgData.format = uimg::Format::RGB32;
+	denoise::ImageData imgView {static_cast<uint8_t *>(imgBuffer.GetData()), imgBuffer.GetFormat()};
+	auto denoiseImgData = imgView.GetSubView(imgWidth, xOffset, yOffset);
 
 	denoise::ImageInputs inputs {};
 	inputs.beautyImage = denoiseImgData;
 	denoise::denoise(denoiseInfo, inputs, denoiseImgData);
-
-	// Copy the denoised area back into the original image
-	for(auto y = decltype(h) {0u}; y < h; ++y) {
-		for(auto x = decltype(w) {0u}; x < w; ++x) {
-			auto srcPxIdx = pxStartOffset + y * imgWidth + x;
-			//if(inOutImgData[srcPxIdx *4 +3] == 0.f)
-			//	continue; // Alpha is zero; Skip this one
-			auto dstPxIdx = y * w + x;
-			//for(uint8_t i=0;i<3;++i)
-			//	inOutImgData[srcPxIdx *4 +i] = imgAreaData.at(dstPxIdx *3 +i);
-			/*if(inOutImgData[srcPxIdx *4 +3] == 0.f)
-			{
-			inOutImgData[srcPxIdx *4 +0] = 0.f;
-			inOutImgData[srcPxIdx *4 +1] = 0.f;
-			inOutImgData[srcPxIdx *4 +2] = 0.f;
-			inOutImgData[srcPxIdx *4 +3] = 1.f;
-			}
-			else
-			{
-			inOutImgData[srcPxIdx *4 +0] = 1.f;
-			inOutImgData[srcPxIdx *4 +1] = 1.f;
-			inOutImgData[srcPxIdx *4 +2] = 1.f;
-			inOutImgData[srcPxIdx *4 +3] = 1.f;
-			}*/
-		}
-	}
 }
 
 void pragma::scenekit::Scene::Close()
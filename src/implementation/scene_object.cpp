@@ -8,6 +8,13 @@ module pragma.scenekit;
 import :scene_object;
 
 static pragma::scenekit::BaseObject *target = nullptr;
+std::size_t pragma::scenekit::MurmurHash3Hasher::operator()(const util::MurmurHash3 &hash) const
+{
+	// The hash is already uniformly distributed, so any of its bytes will do
+	std::size_t result = 0;
+	std::memcpy(&result, hash.data(), umath::min(sizeof(result), hash.size() * sizeof(hash[0])));
+	return result;
+}
 pragma::scenekit::BaseObject::BaseObject() {}
 pragma::scenekit::BaseObject::~BaseObject() {}
 pragma::scenekit::Scene &pragma::scenekit::SceneObject::GetScene() const { return m_scene; }
@@ -0,0 +1,265 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :temporal_denoiser;
+
+namespace {
+	struct FloatImageView {
+		const float *data = nullptr;
+		uint32_t numChannels = 0;
+		bool IsValid() const { return data != nullptr; }
+		const float *GetPixel(size_t idx) const { return data + idx * numChannels; }
+	};
+	FloatImageView get_float_image_view(const uimg::ImageBuffer *img, uint32_t width, uint32_t height)
+	{
+		if(!img || img->GetWidth() != width || img->GetHeight() != height)
+			return {};
+		uint32_t numChannels = 0;
+		switch(img->GetFormat()) {
+		case uimg::Format::R32:
+			numChannels = 1;
+			break;
+		case uimg::Format::RG32:
+			numChannels = 2;
+			break;
+		case uimg::Format::RGB32:
+			numChannels = 3;
+			break;
+		case uimg::Format::RGBA32:
+			numChannels = 4;
+			break;
+		default:
+			return {};
+		}
+		return {static_cast<const float *>(img->GetData()), numChannels};
+	}
+
+	struct CameraProjection {
+		Vector3 origin;
+		Vector3 forward;
+		Vector3 right;
+		Vector3 up;
+		float tanX = 1.f;
+		float tanY = 1.f;
+		uint32_t width = 0;
+		uint32_t height = 0;
+	};
+	CameraProjection get_camera_projection(const pragma::scenekit::denoise::TemporalDenoiser::CameraInfo &camera, uint32_t width, uint32_t height)
+	{
+		CameraProjection proj {};
+		auto &rot = camera.pose.GetRotation();
+		proj.origin = camera.pose.GetOrigin();
+		proj.forward = uquat::forward(rot);
+		proj.right = uquat::right(rot);
+		proj.up = uquat::up(rot);
+		proj.width = width;
+		proj.height = height;
+		auto tanHalfFov = std::tan(umath::deg_to_rad(camera.fov) * 0.5f);
+		auto aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+		if(width >= height) {
+			proj.tanX = tanHalfFov;
+			proj.tanY = tanHalfFov / aspectRatio;
+		}
+		else {
+			proj.tanX = tanHalfFov * aspectRatio;
+			proj.tanY = tanHalfFov;
+		}
+		return proj;
+	}
+	// Returns the continuous pixel coordinates (row 0 at the top) and the planar depth of a world position
+	bool project(const CameraProjection &proj, const Vector3 &pos, float &outX, float &outY, float &outDepth)
+	{
+		auto d = pos - proj.origin;
+		outDepth = uvec::dot(d, proj.forward);
+		if(outDepth <= 1e-4f)
+			return false;
+		auto ndcX = uvec::dot(d, proj.right) / (outDepth * proj.tanX);
+		auto ndcY = uvec::dot(d, proj.up) / (outDepth * proj.tanY);
+		outX = (ndcX * 0.5f + 0.5f) * proj.width;
+		outY = (0.5f - ndcY * 0.5f) * proj.height;
+		return true;
+	}
+	Vector3 unproject(const CameraProjection &proj, float x, float y, float depth)
+	{
+		auto ndcX = (x / proj.width) * 2.f - 1.f;
+		auto ndcY = 1.f - (y / proj.height) * 2.f;
+		return proj.origin + (proj.forward + proj.right * (ndcX * proj.tanX) + proj.up * (ndcY * proj.tanY)) * depth;
+	}
+};
+
+void pragma::scenekit::denoise::TemporalDenoiser::History::Resize(size_t numPixels, bool hasNormals)
+{
+	color.resize(numPixels * 3);
+	depth.resize(numPixels);
+	if(hasNormals)
+		normals.resize(numPixels * 3);
+	else
+		normals.clear();
+	length.resize(numPixels);
+}
+
+void pragma::scenekit::denoise::TemporalDenoiser::Reset() { m_hasHistory = false; }
+
+bool pragma::scenekit::denoise::TemporalDenoiser::Denoise(const Info &denoise, const CameraInfo &camera, const FrameInputs &inputs, const std::function<bool(float)> &fProgressCallback)
+{
+	if(!inputs.color)
+		return false;
+	auto &color = *inputs.color;
+	auto width = color.GetWidth();
+	auto height = color.GetHeight();
+
+	auto spatialInfo = denoise;
+	spatialInfo.width = width;
+	spatialInfo.height = height;
+	if(!pragma::scenekit::denoise::denoise(spatialInfo, color, inputs.albedo, inputs.normal, fProgressCallback)) {
+		Reset();
+		return false;
+	}
+
+	auto colorView = get_float_image_view(&color, width, height);
+	auto positionView = get_float_image_view(inputs.position, width, height);
+	auto depthView = get_float_image_view(inputs.depth, width, height);
+	auto normalView = get_float_image_view(inputs.normal, width, height);
+	if(!colorView.IsValid() || colorView.numChannels < 3 || !camera.perspective || (!positionView.IsValid() && !depthView.IsValid())) {
+		// The frame can't be reprojected, so it can't be used as history either
+		if(!positionView.IsValid() && !depthView.IsValid() && !m_missingGeometryReported) {
+			std::cout << "[TemporalDenoiser] Neither a position nor a depth pass is available, frames are only denoised spatially!" << std::endl;
+			m_missingGeometryReported = true;
+		}
+		Reset();
+		return true;
+	}
+	if(positionView.IsValid() && positionView.numChannels < 3)
+		positionView = {};
+	if(normalView.IsValid() && normalView.numChannels < 3)
+		normalView = {};
+
+	auto numPixels = static_cast<size_t>(width) * height;
+	auto proj = get_camera_projection(camera, width, height);
+	auto *colorData = static_cast<float *>(color.GetData());
+
+	// World positions and planar depths of the current frame
+	m_nextHistory.Resize(numPixels, normalView.IsValid());
+	m_positions.resize(numPixels);
+	for(uint32_t y = 0; y < height; ++y) {
+		for(uint32_t x = 0; x < width; ++x) {
+			auto idx = static_cast<size_t>(y) * width + x;
+			auto &pos = m_positions[idx];
+			auto depth = std::numeric_limits<float>::infinity();
+			if(positionView.IsValid()) {
+				auto *p = positionView.GetPixel(idx);
+				pos = {p[0], p[1], p[2]};
+				float px, py;
+				if(!project(proj, pos, px, py, depth))
+					depth = std::numeric_limits<float>::infinity();
+			}
+			else {
+				auto d = depthView.GetPixel(idx)[0];
+				if(d > 0.f && std::isfinite(d)) {
+					depth = d;
+					pos = unproject(proj, x + 0.5f, y + 0.5f, d);
+				}
+			}
+			m_nextHistory.depth[idx] = depth;
+			if(normalView.IsValid())
+				std::memcpy(m_nextHistory.normals.data() + idx * 3, normalView.GetPixel(idx), sizeof(float) * 3);
+		}
+	}
+
+	m_currentColor.resize(numPixels * 3);
+	for(size_t i = 0; i < numPixels; ++i)
+		std::memcpy(m_currentColor.data() + i * 3, colorView.GetPixel(i), sizeof(float) * 3);
+
+	auto hasHistory = m_hasHistory && m_historyWidth == width && m_historyHeight == height;
+	auto useNormals = hasHistory && normalView.IsValid() && !m_history.normals.empty();
+	auto prevProj = get_camera_projection(m_historyCamera, width, height);
+	for(uint32_t y = 0; y < height; ++y) {
+		for(uint32_t x = 0; x < width; ++x) {
+			auto idx = static_cast<size_t>(y) * width + x;
+			auto *cur = m_currentColor.data() + idx * 3;
+			auto *out = m_nextHistory.color.data() + idx * 3;
+			std::memcpy(out, cur, sizeof(float) * 3);
+			m_nextHistory.length[idx] = 0;
+			if(!hasHistory || !std::isfinite(m_nextHistory.depth[idx]))
+				continue;
+
+			float prevX, prevY, prevDepth;
+			if(!project(prevProj, m_positions[idx], prevX, prevY, prevDepth))
+				continue;
+			// Bilinear filtering over the history samples that pass the depth and normal tests
+			auto sx = prevX - 0.5f;
+			auto sy = prevY - 0.5f;
+			auto x0 = static_cast<int64_t>(std::floor(sx));
+			auto y0 = static_cast<int64_t>(std::floor(sy));
+			auto fx = sx - x0;
+			auto fy = sy - y0;
+			std::array<float, 3> historyColor {0.f, 0.f, 0.f};
+			auto weightSum = 0.f;
+			uint8_t historyLength = 0;
+			for(uint8_t tap = 0; tap < 4; ++tap) {
+				auto tx = x0 + (tap % 2);
+				auto ty = y0 + (tap / 2);
+				if(tx < 0 || ty < 0 || tx >= width || ty >= height)
+					continue;
+				auto weight = ((tap % 2) ? fx : (1.f - fx)) * ((tap / 2) ? fy : (1.f - fy));
+				if(weight <= 0.f)
+					continue;
+				auto tapIdx = static_cast<size_t>(ty) * width + tx;
+				auto tapDepth = m_history.depth[tapIdx];
+				if(!std::isfinite(tapDepth) || std::abs(tapDepth - prevDepth) > m_settings.depthTolerance * prevDepth)
+					continue;
+				if(useNormals) {
+					auto *n0 = m_history.normals.data() + tapIdx * 3;
+					auto *n1 = m_nextHistory.normals.data() + idx * 3;
+					if(n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < m_settings.normalThreshold)
+						continue;
+				}
+				auto *c = m_history.color.data() + tapIdx * 3;
+				for(uint8_t i = 0; i < 3; ++i)
+					historyColor[i] += c[i] * weight;
+				weightSum += weight;
+				historyLength = umath::max(historyLength, m_history.length[tapIdx]);
+			}
+			if(weightSum < 0.01f)
+				continue; // Disoccluded
+
+			std::array<float, 3> minColor {cur[0], cur[1], cur[2]};
+			std::array<float, 3> maxColor = minColor;
+			if(m_settings.clampHistory) {
+				for(auto ny = (y > 0) ? (y - 1) : y; ny <= umath::min(y + 1, height - 1); ++ny) {
+					for(auto nx = (x > 0) ? (x - 1) : x; nx <= umath::min(x + 1, width - 1); ++nx) {
+						auto *n = m_currentColor.data() + (static_cast<size_t>(ny) * width + nx) * 3;
+						for(uint8_t i = 0; i < 3; ++i) {
+							minColor[i] = umath::min(minColor[i], n[i]);
+							maxColor[i] = umath::max(maxColor[i], n[i]);
+						}
+					}
+				}
+			}
+			auto length = static_cast<uint8_t>(umath::min<uint32_t>(historyLength + 1u, umath::min(m_settings.maxHistoryLength, 255u)));
+			auto currentWeight = 1.f / (length + 1);
+			for(uint8_t i = 0; i < 3; ++i) {
+				auto h = historyColor[i] / weightSum;
+				if(m_settings.clampHistory)
+					h = std::clamp(h, minColor[i], maxColor[i]);
+				out[i] = h + (cur[i] - h) * currentWeight;
+			}
+			m_nextHistory.length[idx] = length;
+		}
+	}
+
+	// Write the blended result, the alpha channel is left untouched
+	for(size_t i = 0; i < numPixels; ++i)
+		std::memcpy(colorData + i * colorView.numChannels, m_nextHistory.color.data() + i * 3, sizeof(float) * 3);
+
+	std::swap(m_history, m_nextHistory);
+	m_historyCamera = camera;
+	m_historyWidth = width;
+	m_historyHeight = height;
+	m_hasHistory = true;
+	return true;
+}
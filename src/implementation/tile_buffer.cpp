@@ -0,0 +1,92 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :tile_buffer;
+
+std::shared_ptr<pragma::scenekit::TileBufferPool> pragma::scenekit::TileBufferPool::Create(size_t slabSize) { return std::shared_ptr<TileBufferPool> {new TileBufferPool {slabSize}}; }
+pragma::scenekit::TileBufferPool::TileBufferPool(size_t slabSize) : m_slabSize {slabSize} {}
+pragma::scenekit::TileBufferPool::~TileBufferPool() { Clear(); }
+size_t pragma::scenekit::TileBufferPool::GetIdleSlabCount() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_idleSlabs.size();
+}
+void pragma::scenekit::TileBufferPool::Clear()
+{
+	std::scoped_lock lock {m_mutex};
+	for(auto *slab : m_idleSlabs)
+		delete[] slab;
+	m_idleSlabs.clear();
+}
+void pragma::scenekit::TileBufferPool::Release(uint8_t *slab)
+{
+	std::scoped_lock lock {m_mutex};
+	if(m_idleSlabs.size() == m_idleSlabs.capacity())
+		m_idleSlabs.reserve(m_idleSlabs.size() * 1.5 + 50);
+	m_idleSlabs.push_back(slab);
+}
+std::shared_ptr<uint8_t[]> pragma::scenekit::TileBufferPool::Acquire(size_t size)
+{
+	if(size > m_slabSize)
+		return std::shared_ptr<uint8_t[]> {new uint8_t[size]};
+	uint8_t *slab = nullptr;
+	m_mutex.lock();
+	if(!m_idleSlabs.empty()) {
+		slab = m_idleSlabs.back();
+		m_idleSlabs.pop_back();
+	}
+	m_mutex.unlock();
+	if(!slab)
+		slab = new uint8_t[m_slabSize];
+	// The slab is handed back to the pool once the last reference has been released, unless the pool
+	// has been destroyed in the meantime
+	return std::shared_ptr<uint8_t[]> {slab, [wpPool = weak_from_this()](uint8_t *slab) {
+		                                   auto pool = wpPool.lock();
+		                                   if(pool)
+			                                   pool->Release(slab);
+		                                   else
+			                                   delete[] slab;
+	                                   }};
+}
+
+//////////
+
+pragma::scenekit::TileBuffer::TileBuffer(const std::shared_ptr<TileBufferPool> &pool) : m_pool {pool} {}
+std::shared_ptr<uint8_t[]> pragma::scenekit::TileBuffer::Allocate(size_t size) const
+{
+	if(m_pool)
+		return m_pool->Acquire(size);
+	return std::shared_ptr<uint8_t[]> {new uint8_t[size]};
+}
+void pragma::scenekit::TileBuffer::resize(size_t size)
+{
+	if(size > m_capacity || !IsUnique()) {
+		auto data = Allocate(size);
+		// Like std::vector, the existing contents are preserved
+		auto numPreserved = umath::min(size, m_size);
+		if(numPreserved > 0)
+			std::memcpy(data.get(), m_data.get(), numPreserved);
+		m_data = std::move(data);
+		m_capacity = (m_pool && size <= m_pool->GetSlabSize()) ? m_pool->GetSlabSize() : size;
+	}
+	m_size = size;
+}
+void pragma::scenekit::TileBuffer::clear()
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_capacity = 0;
+}
+void pragma::scenekit::TileBuffer::MakeUnique()
+{
+	if(IsUnique())
+		return;
+	auto data = Allocate(m_size);
+	std::memcpy(data.get(), m_data.get(), m_size);
+	m_data = std::move(data);
+	m_capacity = (m_pool && m_size <= m_pool->GetSlabSize()) ? m_pool->GetSlabSize() : m_size;
+}
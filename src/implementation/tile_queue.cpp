@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :tile_queue;
+
+static uint64_t hilbert_index(uint32_t n, uint32_t x, uint32_t y)
+{
+	uint64_t d = 0;
+	for(auto s = n / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
+		// Rotate the quadrant
+		if(ry == 0) {
+			if(rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+void pragma::scenekit::TileQueue::Initialize(uint32_t numTilesX, uint32_t numTilesY)
+{
+	m_numTilesX = numTilesX;
+	m_numTilesY = numTilesY;
+	auto numTiles = static_cast<size_t>(numTilesX) * numTilesY;
+	m_ranks.assign(numTiles, 0);
+	m_passes.assign(numTiles, 0);
+	m_inRegion.assign(numTiles, false);
+	m_queued.assign(numTiles, false);
+	m_heap.clear();
+	m_heap.reserve(numTiles);
+	m_nextSequence = 0;
+	UpdateRanks();
+}
+
+void pragma::scenekit::TileQueue::SetPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest)
+{
+	m_policy = policy;
+	m_regionOfInterest = regionOfInterest;
+	UpdateRanks();
+	for(auto &entry : m_heap) {
+		entry.rank = GetRank(entry.tileIndex);
+		entry.pass = GetPass(entry.tileIndex);
+	}
+	std::make_heap(m_heap.begin(), m_heap.end(), &HasLowerPriority);
+}
+
+void pragma::scenekit::TileQueue::UpdateRanks()
+{
+	auto numTiles = m_ranks.size();
+	std::fill(m_inRegion.begin(), m_inRegion.end(), false);
+	if(m_policy == TileSchedulingPolicy::Fifo) {
+		std::fill(m_ranks.begin(), m_ranks.end(), 0);
+		return;
+	}
+	std::vector<uint32_t> order(numTiles);
+	std::iota(order.begin(), order.end(), 0);
+	// Tile indices are in row-major order
+	auto getTilePos = [this](uint32_t tileIndex) -> std::pair<uint32_t, uint32_t> { return {tileIndex % m_numTilesX, tileIndex / m_numTilesX}; };
+	switch(m_policy) {
+	case TileSchedulingPolicy::CenterOut:
+		{
+			// Tiles are sorted by the square ring they're on and then by their angle on that ring
+			auto cx = m_numTilesX * 0.5;
+			auto cy = m_numTilesY * 0.5;
+			std::vector<std::pair<double, double>> keys(numTiles);
+			for(auto i = decltype(numTiles) {0u}; i < numTiles; ++i) {
+				auto [x, y] = getTilePos(i);
+				auto dx = (x + 0.5) - cx;
+				auto dy = (y + 0.5) - cy;
+				keys[i] = {std::max(std::abs(dx), std::abs(dy)), std::atan2(dy, dx)};
+			}
+			std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return (keys[a] != keys[b]) ? (keys[a] < keys[b]) : (a < b); });
+			break;
+		}
+	case TileSchedulingPolicy::Hilbert:
+		{
+			uint32_t n = 1;
+			while(n < m_numTilesX || n < m_numTilesY)
+				n *= 2;
+			std::vector<uint64_t> keys(numTiles);
+			for(auto i = decltype(numTiles) {0u}; i < numTiles; ++i) {
+				auto [x, y] = getTilePos(i);
+				keys[i] = hilbert_index(n, x, y);
+			}
+			std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+			break;
+		}
+	case TileSchedulingPolicy::RegionOfInterest:
+		{
+			// Tiles overlapping the region come first, the remaining tiles are sorted by their distance to the region.
+			// Ties are broken by the distance to the center of the region, so the region itself is refined center-out.
+			auto &roi = m_regionOfInterest;
+			auto minX = std::min(roi.minX, roi.maxX) * m_numTilesX;
+			auto maxX = std::max(roi.minX, roi.maxX) * m_numTilesX;
+			auto minY = std::min(roi.minY, roi.maxY) * m_numTilesY;
+			auto maxY = std::max(roi.minY, roi.maxY) * m_numTilesY;
+			auto cx = (minX + maxX) * 0.5f;
+			auto cy = (minY + maxY) * 0.5f;
+			std::vector<std::pair<float, float>> keys(numTiles);
+			for(auto i = decltype(numTiles) {0u}; i < numTiles; ++i) {
+				auto [x, y] = getTilePos(i);
+				auto dx = std::max({minX - (x + 1.f), x - maxX, 0.f});
+				auto dy = std::max({minY - (y + 1.f), y - maxY, 0.f});
+				auto ox = (x + 0.5f) - cx;
+				auto oy = (y + 0.5f) - cy;
+				keys[i] = {dx * dx + dy * dy, ox * ox + oy * oy};
+				m_inRegion[i] = (keys[i].first == 0.f);
+			}
+			std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return (keys[a] != keys[b]) ? (keys[a] < keys[b]) : (a < b); });
+			break;
+		}
+	default:
+		break;
+	}
+	for(auto i = decltype(numTiles) {0u}; i < numTiles; ++i)
+		m_ranks[order[i]] = i;
+}
+
+bool pragma::scenekit::TileQueue::HasLowerPriority(const Entry &a, const Entry &b)
+{
+	// std::push_heap creates a max-heap, so the comparison is reversed
+	if(a.pass != b.pass)
+		return a.pass > b.pass;
+	if(a.rank != b.rank)
+		return a.rank > b.rank;
+	return a.sequence > b.sequence;
+}
+
+uint32_t pragma::scenekit::TileQueue::GetPass(size_t tileIndex) const
+{
+	if(tileIndex >= m_passes.size() || m_policy == TileSchedulingPolicy::Fifo)
+		return 0;
+	// Tiles inside the region of interest are treated as if they had never been processed, so they're ordered by rank only
+	// and always precede the remaining tiles (which have higher ranks)
+	if(m_inRegion[tileIndex])
+		return 0;
+	return m_passes[tileIndex];
+}
+
+void pragma::scenekit::TileQueue::push(size_t tileIndex)
+{
+	auto isGridTile = tileIndex < m_queued.size();
+	if(isGridTile) {
+		if(m_queued[tileIndex])
+			return; // Already queued, the tile data will be picked up by the existing entry
+		m_queued[tileIndex] = true;
+	}
+	Entry entry {};
+	entry.pass = GetPass(tileIndex);
+	entry.rank = GetRank(tileIndex);
+	entry.sequence = m_nextSequence++;
+	entry.tileIndex = tileIndex;
+	if(m_heap.size() == m_heap.capacity())
+		m_heap.reserve(m_heap.size() * 1.5 + 100);
+	m_heap.push_back(entry);
+	std::push_heap(m_heap.begin(), m_heap.end(), &HasLowerPriority);
+}
+
+void pragma::scenekit::TileQueue::pop()
+{
+	std::pop_heap(m_heap.begin(), m_heap.end(), &HasLowerPriority);
+	auto tileIndex = m_heap.back().tileIndex;
+	m_heap.pop_back();
+	if(tileIndex < m_queued.size()) {
+		m_queued[tileIndex] = false;
+		++m_passes[tileIndex];
+	}
+}
+
+size_t pragma::scenekit::TileQueue::front() const { return m_heap.front().tileIndex; }
+
+void pragma::scenekit::TileQueue::clear()
+{
+	m_heap.clear();
+	std::fill(m_queued.begin(), m_queued.end(), false);
+	std::fill(m_passes.begin(), m_passes.end(), 0);
+	m_nextSequence = 0;
+}
@@ -0,0 +1,215 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+module pragma.scenekit;
+
+import :tile_stream_writer;
+
+std::unique_ptr<pragma::scenekit::TileStreamWriter> pragma::scenekit::TileStreamWriter::Create(const std::string &fileName, uint32_t width, uint32_t height, uint32_t maxPendingTiles, std::string &outErr)
+{
+	Header header {};
+	header.width = width;
+	header.height = height;
+	{
+		std::ofstream f {fileName, std::ios::binary | std::ios::trunc};
+		if(!f) {
+			outErr = "Unable to open file '" + fileName + "' for writing!";
+			return nullptr;
+		}
+		f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		if(!f) {
+			outErr = "Unable to write header to '" + fileName + "'!";
+			return nullptr;
+		}
+	}
+	// Reserve the full file size up front, so tiles can be written to their final location in any order.
+	// On most file systems this creates a sparse file and doesn't actually write any data.
+	std::error_code ec;
+	std::filesystem::resize_file(fileName, sizeof(header) + static_cast<uint64_t>(width) * height * sizeof(float) * 4, ec);
+	if(ec) {
+		outErr = "Unable to resize '" + fileName + "': " + ec.message();
+		return nullptr;
+	}
+	auto writer = std::unique_ptr<TileStreamWriter> {new TileStreamWriter {fileName, width, height, maxPendingTiles}};
+	if(!writer->m_file) {
+		outErr = "Unable to open file '" + fileName + "' for writing!";
+		return nullptr;
+	}
+	writer->m_thread = std::thread {[writer = writer.get()]() { writer->Run(); }};
+	return writer;
+}
+
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::TileStreamWriter::ReadImage(const std::string &fileName, std::string &outErr)
+{
+	std::ifstream f {fileName, std::ios::binary};
+	if(!f) {
+		outErr = "Unable to open file '" + fileName + "' for reading!";
+		return nullptr;
+	}
+	Header header {};
+	f.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if(!f || header.magic != Header {}.magic || header.version != Header {}.version || header.numChannels != 4 || header.bytesPerChannel != sizeof(float)) {
+		outErr = "File '" + fileName + "' is not a valid tile stream!";
+		return nullptr;
+	}
+	auto img = uimg::ImageBuffer::Create(header.width, header.height, uimg::Format::RGBA_FLOAT);
+	f.read(static_cast<char *>(img->GetData()), img->GetSize());
+	if(!f) {
+		outErr = "Unable to read pixel data from '" + fileName + "'!";
+		return nullptr;
+	}
+	return img;
+}
+
+pragma::scenekit::TileStreamWriter::TileStreamWriter(const std::string &fileName, uint32_t width, uint32_t height, uint32_t maxPendingTiles)
+    : m_fileName {fileName}, m_file {fileName, std::ios::binary | std::ios::in | std::ios::out}, m_width {width}, m_height {height}, m_maxPendingTiles {std::max(maxPendingTiles, 1u)}
+{
+}
+
+pragma::scenekit::TileStreamWriter::~TileStreamWriter() { Close(); }
+
+void pragma::scenekit::TileStreamWriter::SetError(const std::string &err)
+{
+	std::scoped_lock lock {m_mutex};
+	if(m_error.empty())
+		m_error = err;
+}
+bool pragma::scenekit::TileStreamWriter::HasError() const
+{
+	std::scoped_lock lock {m_mutex};
+	return !m_error.empty();
+}
+std::string pragma::scenekit::TileStreamWriter::GetError() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_error;
+}
+size_t pragma::scenekit::TileStreamWriter::GetPendingTileCount() const
+{
+	std::scoped_lock lock {m_mutex};
+	return m_pendingTiles.size();
+}
+
+bool pragma::scenekit::TileStreamWriter::Enqueue(Tile &tile, bool &outQueued)
+{
+	outQueued = false;
+	if(m_closing)
+		return true;
+	auto it = std::find_if(m_pendingTiles.begin(), m_pendingTiles.end(), [&tile](const Tile &other) { return other.key == tile.key; });
+	if(it != m_pendingTiles.end()) {
+		// The previous sample hasn't been written yet, we can just replace it
+		if(tile.sample >= it->sample)
+			*it = std::move(tile);
+		return true;
+	}
+	if(m_pendingTiles.size() >= m_maxPendingTiles)
+		return false;
+	m_pendingTiles.push_back(std::move(tile));
+	outQueued = true;
+	return true;
+}
+
+void pragma::scenekit::TileStreamWriter::Write(Tile &&tile)
+{
+	std::unique_lock lock {m_mutex};
+	auto queued = false;
+	while(!Enqueue(tile, queued))
+		m_writtenCondition.wait(lock);
+	lock.unlock();
+	if(queued)
+		m_pendingCondition.notify_one();
+}
+
+bool pragma::scenekit::TileStreamWriter::TryWrite(Tile &tile)
+{
+	std::unique_lock lock {m_mutex};
+	auto queued = false;
+	if(!Enqueue(tile, queued))
+		return false;
+	lock.unlock();
+	if(queued)
+		m_pendingCondition.notify_one();
+	return true;
+}
+
+void pragma::scenekit::TileStreamWriter::Flush()
+{
+	std::unique_lock lock {m_mutex};
+	m_writtenCondition.wait(lock, [this]() { return m_pendingTiles.empty() && !m_writing; });
+}
+
+bool pragma::scenekit::TileStreamWriter::Close()
+{
+	if(!m_thread.joinable())
+		return !HasError();
+	m_mutex.lock();
+	m_closing = true;
+	m_mutex.unlock();
+	m_pendingCondition.notify_one();
+	m_writtenCondition.notify_all();
+	m_thread.join();
+	m_file.close();
+	if(m_file.fail())
+		SetError("Unable to close file '" + m_fileName + "'!");
+	return !HasError();
+}
+
+void pragma::scenekit::TileStreamWriter::Run()
+{
+	std::unique_lock lock {m_mutex};
+	for(;;) {
+		m_pendingCondition.wait(lock, [this]() { return !m_pendingTiles.empty() || m_closing; });
+		// Pending tiles are always written, even if we're closing
+		if(m_pendingTiles.empty())
+			break;
+		auto tile = std::move(m_pendingTiles.front());
+		m_pendingTiles.pop_front();
+		m_writing = true;
+		lock.unlock();
+		// Wake up producers that are waiting for space
+		m_writtenCondition.notify_all();
+
+		if(WriteTile(tile))
+			++m_numWrittenTiles;
+		tile = {}; // Return the buffer to the pool before waiting for new tiles
+
+		lock.lock();
+		if(m_pendingTiles.empty()) {
+			// m_writing is still set at this point, so Flush won't return before the data has been flushed
+			lock.unlock();
+			m_file.flush();
+			if(!m_file)
+				SetError("Unable to flush file '" + m_fileName + "'!");
+			lock.lock();
+		}
+		m_writing = false;
+		lock.unlock();
+		m_writtenCondition.notify_all();
+		lock.lock();
+	}
+}
+
+bool pragma::scenekit::TileStreamWriter::WriteTile(const Tile &tile)
+{
+	if(tile.x + tile.w > m_width || tile.y + tile.h > m_height || tile.data.size() < static_cast<size_t>(tile.w) * tile.h * sizeof(float) * 4) {
+		std::cout << "[TileStreamWriter] Skipping tile (" << tile.x << ", " << tile.y << ", " << tile.w << ", " << tile.h << ") which is out of bounds!" << std::endl;
+		return false;
+	}
+	if(!m_file)
+		return false; // An error has already occurred
+	constexpr auto pixelSize = sizeof(float) * 4;
+	auto rowSize = static_cast<std::streamsize>(tile.w) * pixelSize;
+	auto *data = reinterpret_cast<const char *>(tile.data.data());
+	for(uint32_t y = 0; y < tile.h; ++y) {
+		auto offset = sizeof(Header) + (static_cast<uint64_t>(tile.y + y) * m_width + tile.x) * pixelSize;
+		m_file.seekp(offset);
+		m_file.write(data + y * rowSize, rowSize);
+	}
+	if(!m_file) {
+		SetError("Unable to write tile to '" + m_fileName + "'!");
+		return false;
+	}
+	return true;
+}
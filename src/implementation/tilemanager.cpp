@@ -8,11 +8,18 @@ module pragma.scenekit;
 import pragma.ocio;
 
 import :tile_manager;
+import :post_processing_pool;
+import :image_kernels;
+import :latency_histogram;
 
 bool pragma::scenekit::TileManager::TileData::IsFloatData() const { return !IsHDRData(); }
 bool pragma::scenekit::TileManager::TileData::IsHDRData() const { return umath::is_flag_set(flags, Flags::HDRData); }
 
-pragma::scenekit::TileManager::~TileManager() { StopAndWait(); }
+pragma::scenekit::TileManager::~TileManager()
+{
+	StopAndWait();
+	PostProcessingPool::GetInstance().RemoveClient(*this);
+}
 
 void pragma::scenekit::TileManager::StopAndWait()
 {
@@ -20,25 +27,155 @@ void pragma::scenekit::TileManager::StopAndWait()
 	Wait();
 }
 
-void pragma::scenekit::TileManager::SetState(State state)
+void pragma::scenekit::TileManager::SetState(State state) { m_state = state; }
+
+void pragma::scenekit::TileManager::NotifyPendingWork()
 {
-	m_state = state;
-	m_threadWaitCondition.notify_all();
+	// Tiles pushed into the input tile queue are stamped as early as possible, so the queue wait isn't underestimated.
+	// If a worker currently holds the lock, it'll drain (and stamp) the queue itself.
+	if(m_inputTileMutex.try_lock()) {
+		DrainInputTileQueue();
+		m_inputTileMutex.unlock();
+	}
+	TryScheduleWorker();
 }
 
-void pragma::scenekit::TileManager::NotifyPendingWork()
+bool pragma::scenekit::TileManager::TryScheduleWorker()
+{
+	auto state = m_state.load();
+	if(state != State::Running && state != State::Stopped)
+		return false;
+	auto budget = PostProcessingPool::GetInstance().GetWorkerBudget(*this);
+	auto numActive = m_numActiveWorkers.load();
+	do {
+		if(numActive >= budget)
+			return false; // Our active workers will pick up the work
+	} while(!m_numActiveWorkers.compare_exchange_weak(numActive, numActive + 1));
+	PostProcessingPool::GetInstance().Submit([this]() { RunWorker(); });
+	return true;
+}
+
+void pragma::scenekit::TileManager::RunWorker()
+{
+	std::unique_lock<std::mutex> lock {m_inputTileMutex, std::defer_lock};
+	for(;;) {
+		lock.lock();
+		// If we've been stopped, we'll finish the remaining work first
+		DrainInputTileQueue();
+		if(m_state == State::Cancelled || m_scheduledTileQueue.empty())
+			break;
+		auto tileIndex = m_scheduledTileQueue.front();
+		m_scheduledTileQueue.pop();
+		auto hasMoreWork = !m_scheduledTileQueue.empty();
+		auto &inputTile = m_inputTiles[tileIndex];
+		if(inputTile.sample == std::numeric_limits<decltype(inputTile.sample)>::max() || inputTile.data.empty()) {
+			// The tile was queued more than once and has already been processed, or has been invalidated by a reload
+			lock.unlock();
+			continue;
+		}
+		// We take ownership of the tile buffer. The slot gets a new buffer of the same size, so renderers that write
+		// into GetInputTiles() directly don't have to resize it for the next sample.
+		auto tile = std::move(inputTile);
+		inputTile.data = TileBuffer {m_tileBufferPool};
+		inputTile.data.resize(tile.data.size());
+		inputTile.sample = std::numeric_limits<decltype(inputTile.sample)>::max();
+		inputTile.timestamp = 0;
+		lock.unlock();
+		RecordStageLatency(PipelineStage::QueueWait, tile.timestamp);
+
+		// Producers only wake a single worker, so we have to pass the remaining work on
+		if(hasMoreWork)
+			TryScheduleWorker();
+
+		if(ProcessInputTile(tileIndex, tile) == false) {
+			lock.lock();
+			break;
+		}
+	}
+	// The worker count has to be decremented under the queue lock, otherwise a producer could
+	// queue a tile after we've checked the queue without scheduling a new worker for it
+	--m_numActiveWorkers;
+	m_numActiveWorkers.notify_all();
+	lock.unlock();
+}
+
+void pragma::scenekit::TileManager::DrainInputTileQueue()
+{
+	uint64_t timestamp = 0;
+	while(!m_inputTileQueue.empty()) {
+		auto tileIndex = m_inputTileQueue.front();
+		// Tiles that have been written into GetInputTiles() directly haven't been stamped yet
+		if(tileIndex < m_inputTiles.size() && m_inputTiles[tileIndex].timestamp == 0) {
+			if(timestamp == 0)
+				timestamp = GetInstrumentationTimestamp();
+			m_inputTiles[tileIndex].timestamp = timestamp;
+		}
+		m_scheduledTileQueue.push(tileIndex);
+		m_inputTileQueue.pop();
+	}
+}
+
+pragma::scenekit::TileManager::TileLease pragma::scenekit::TileManager::LeaseInputTile(uint16_t tileIndex, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t sample)
 {
-	m_hasPendingWork = true;
-	m_threadWaitCondition.notify_all();
+	TileLease lease {};
+	if(tileIndex >= m_numTiles)
+		return lease;
+	auto &tile = lease.tile;
+	tile.index = tileIndex;
+	tile.x = x;
+	tile.y = y;
+	tile.w = w;
+	tile.h = h;
+	tile.sample = sample;
+	tile.data = TileBuffer {m_tileBufferPool};
+	tile.data.resize(static_cast<size_t>(w) * h * TileLease::GetPixelStride());
+	return lease;
+}
+bool pragma::scenekit::TileManager::CommitInputTile(TileLease &&lease)
+{
+	auto tileIndex = lease.tile.index;
+	if(!lease.IsValid() || tileIndex >= m_numTiles)
+		return false;
+	m_inputTileMutex.lock();
+	// If the previous sample of this tile hasn't been processed yet, it's superseded by this one
+	lease.tile.timestamp = GetInstrumentationTimestamp();
+	m_inputTiles[tileIndex] = std::move(lease.tile);
+	m_scheduledTileQueue.push(tileIndex);
+	m_inputTileMutex.unlock();
+	NotifyPendingWork();
+	return true;
 }
 
 void pragma::scenekit::TileManager::Cancel() { SetState(State::Cancelled); }
 void pragma::scenekit::TileManager::Wait()
 {
-	for(auto &threadHandle : m_ppThreadPoolHandles) {
-		if(threadHandle.valid())
-			threadHandle.wait();
-	}
+	for(auto n = m_numActiveWorkers.load(); n > 0; n = m_numActiveWorkers.load())
+		m_numActiveWorkers.wait(n);
+	// Make sure the last worker has released the queue lock before we return
+	std::scoped_lock lock {m_inputTileMutex};
+}
+
+void pragma::scenekit::TileManager::SetWorkerWeight(float weight)
+{
+	m_workerWeight = weight;
+	if(m_numTiles > 0)
+		PostProcessingPool::GetInstance().SetClientWeight(*this, weight);
+}
+
+uint64_t pragma::scenekit::TileManager::GetInstrumentationTimestamp() const { return m_instrumentationEnabled.load(std::memory_order_relaxed) ? LatencyHistogram::GetTimestamp() : 0; }
+void pragma::scenekit::TileManager::RecordStageLatency(PipelineStage stage, uint64_t startTimestamp)
+{
+	// Timestamps are 0 if instrumentation was disabled when the measurement started
+	if(startTimestamp == 0 || !m_instrumentationEnabled.load(std::memory_order_relaxed))
+		return;
+	auto t = LatencyHistogram::GetTimestamp();
+	m_stageLatencies[umath::to_integral(stage)].Record((t > startTimestamp) ? (t - startTimestamp) : 0);
+}
+void pragma::scenekit::TileManager::SetInstrumentationEnabled(bool enabled) { m_instrumentationEnabled = enabled; }
+void pragma::scenekit::TileManager::ResetInstrumentation()
+{
+	for(auto &histogram : m_stageLatencies)
+		histogram.Reset();
 }
 
 void pragma::scenekit::TileManager::SetExposure(float exposure) { m_exposure = exposure; }
@@ -53,12 +190,59 @@ void pragma::scenekit::TileManager::Initialize(uint32_t w, uint32_t h, uint32_t
 	m_numTilesPerAxis = {(w / wTile) + ((w % wTile) > 0 ? 1 : 0), (h / hTile) + ((h % hTile) > 0 ? 1 : 0)};
 	auto numTiles = m_numTilesPerAxis.x * m_numTilesPerAxis.y;
 	m_numTiles = numTiles;
-	m_inputTiles.resize(numTiles);
+	m_tileBufferPool = TileBufferPool::Create(wTile * hTile * sizeof(float) * 4);
+	{
+		std::scoped_lock lock {m_inputTileMutex, m_renderedTileMutex};
+		m_inputTiles.clear();
+		m_inputTiles.resize(numTiles);
+		for(auto &tile : m_inputTiles)
+			tile.data = TileBuffer {m_tileBufferPool};
+		m_inputTileQueue = {};
+		m_scheduledTileQueue.Initialize(m_numTilesPerAxis.x, m_numTilesPerAxis.y);
+	}
+	m_completedTileMutex.lock();
+	m_completedTiles.clear();
 	m_completedTiles.resize(numTiles);
-	m_progressiveImage = uimg::ImageBuffer::Create(w, h, uimg::Format::RGBA_FLOAT);
+	// The convergence estimates are only sized here, Reload resets them in place, since workers may still access them
+	m_tileVarianceEstimates.assign(numTiles, {});
+	m_tileErrors = std::vector<std::atomic<float>>(numTiles);
+	m_tileErrorSampleCounts = std::vector<std::atomic<uint32_t>>(numTiles);
+	m_completedTileMutex.unlock();
+	m_imageSize = {w, h};
+	m_deferredStreamTileMutex.lock();
+	m_deferredStreamTiles.clear();
+	m_deferredStreamTileMutex.unlock();
+	m_streamWriter = nullptr;
+	if(!m_streamFileName.empty()) {
+		std::string err;
+		m_streamWriter = TileStreamWriter::Create(m_streamFileName, w, h, m_streamMaxPendingTiles, err);
+		if(!m_streamWriter)
+			std::cout << "[TileManager] Failed to initialize streaming output, falling back to in-memory image: " << err << std::endl;
+	}
+	// Without streaming, the pyramid shares the tile buffers of the completed tiles, so keeping them around is free
+	m_previewPyramid.Initialize(w, h, wTile, hTile, m_numPreviewLevels, m_useFloatData ? uimg::Format::RGBA_FLOAT : uimg::Format::RGBA_HDR, m_streamWriter == nullptr);
+	// The full-precision image is only required once rendering is complete, so it's created on demand
+	m_progressiveImage = nullptr;
+	m_dirtyTiles.assign(numTiles, false);
+	m_snapshotMutex.lock();
+	for(auto &buf : m_snapshotBuffers)
+		buf = {};
+	m_snapshotMutex.unlock();
+	m_renderedTileMutex.lock();
+	auto numSlots = umath::max(static_cast<uint32_t>(numTiles), 1u);
+	m_renderedTileSlots.clear();
+	m_renderedTileSlots.resize(numSlots);
+	m_renderedTileSlotPending.assign(numSlots, false);
+	m_renderedTileRing.assign((m_requestedRenderedTileCapacity > 0) ? umath::min(m_requestedRenderedTileCapacity, numSlots) : numSlots, 0);
+	m_renderedTileRingHead = 0;
+	m_renderedTileRingSize = 0;
+	m_renderedTileMutex.unlock();
+	m_consumedRenderedTiles.clear();
+	m_consumedRenderedTiles.reserve(numSlots);
 	m_tileSize = {wTile, hTile};
 	m_exposure = exposure;
 	m_gamma = gamma;
+	PostProcessingPool::GetInstance().SetClientWeight(*this, m_workerWeight);
 	Reload(false);
 }
 
@@ -68,11 +252,8 @@ void pragma::scenekit::TileManager::Reload(bool waitForCompletion)
 		StopAndWait();
 	else
 		SetState(State::Cancelled);
-	m_hasPendingWork = false;
 	m_renderedTileMutex.lock();
-	m_renderedTiles.clear();
-	//for(auto &tile : m_renderedTiles)
-	//	tile = {};
+	ClearPendingRenderedTiles();
 
 	m_numTilesWithRenderedSamples = 0;
 	m_renderedSampleCountPerTile = std::vector<std::atomic<uint32_t>>(m_numTiles);
@@ -83,6 +264,11 @@ void pragma::scenekit::TileManager::Reload(bool waitForCompletion)
 	m_completedTileMutex.lock();
 	for(auto &tile : m_completedTiles)
 		tile.sample = std::numeric_limits<uint16_t>::max();
+	std::fill(m_tileVarianceEstimates.begin(), m_tileVarianceEstimates.end(), TileVarianceEstimate {});
+	for(auto &v : m_tileErrors)
+		v = std::numeric_limits<float>::infinity();
+	for(auto &v : m_tileErrorSampleCounts)
+		v = 0;
 	m_completedTileMutex.unlock();
 	// Test
 	/*{
@@ -107,121 +293,435 @@ void pragma::scenekit::TileManager::Reload(bool waitForCompletion)
 	m_inputTileMutex.unlock();
 
 	Wait();
+	// Workers have finished at this point, so no stale tile can end up in the pyramid after it has been cleared
+	m_previewPyramid.Clear();
 	SetState(State::Running);
-	for(auto i = decltype(m_ppThreadPool.size()) {0u}; i < m_ppThreadPool.size(); ++i) {
-		m_ppThreadPoolHandles.at(i) = m_ppThreadPool.push([this](int threadId) {
-			std::unique_lock<std::mutex> mlock(m_threadWaitMutex);
-			for(;;) {
-				// TODO
-				// m_threadWaitCondition.wait(mlock,[this]() {return m_state != State::Running || m_hasPendingWork;});
-				// TODO: ALso see sleep
-
-				while(m_hasPendingWork) {
-					m_inputTileMutex.lock();
-					if(m_state == State::Cancelled) {
-						m_inputTileMutex.unlock();
-						goto endThread;
-					}
-					if(m_inputTileQueue.empty()) {
-						m_inputTileMutex.unlock();
-						break;
-					}
-					auto tileIndex = m_inputTileQueue.front();
-					m_inputTileQueue.pop();
-					if(m_inputTileQueue.empty())
-						m_hasPendingWork = false;
-					auto tile = m_inputTiles[tileIndex];
-					m_inputTileMutex.unlock();
-
-					if(m_state == State::Cancelled)
-						goto endThread;
-
-					InitializeTileData(tile);
-
-					if(m_state == State::Cancelled)
-						goto endThread;
-
-					m_completedTileMutex.lock();
-					if(m_completedTiles[tileIndex].sample == std::numeric_limits<uint16_t>::max() || tile.sample > m_completedTiles[tileIndex].sample)
-						m_completedTiles[tileIndex] = tile; // Completed tile data is float data WITHOUT color correction (color correction will be applied after denoising)
-					m_completedTileMutex.unlock();
-
-					ApplyPostProcessingForProgressiveTile(tile);
-					// Progressive tile is HDR 16-bit data WITH color correction (tile will be discarded when rendering is complete and 'm_completedTiles' tile will be used instead)
-					m_renderedTileMutex.lock();
-					if(m_state == State::Cancelled) {
-						m_renderedTileMutex.unlock();
-						goto endThread;
-					}
-					if(m_renderedTiles.size() == m_renderedTiles.capacity())
-						m_renderedTiles.reserve(m_renderedTiles.size() * 1.5 + 100);
-					m_renderedTiles.push_back(std::move(tile));
-					//if(m_renderedSampleCountPerTile.at(tile.index) == 0)
-					//	++m_numTilesWithRenderedSamples;
-					//m_renderedSampleCountPerTile.at(tile.index) = tile.sample +1;
-
-					uint32_t curSampleCount = m_renderedSampleCountPerTile.at(tile.index);
-					static uint32_t test = 3;
-					if((tile.sample + 1) >= test) {
-						m_renderedSampleCountPerTile.at(tile.index) = tile.sample + 1;
-						if(curSampleCount == 0)
-							++m_numTilesWithRenderedSamples;
-					}
-
-					m_renderedTileMutex.unlock();
-				}
-				if(m_hasPendingWork == false)
-					std::this_thread::sleep_for(std::chrono::milliseconds(100));
-				if((m_state == State::Stopped && m_hasPendingWork == false) || m_state == State::Cancelled)
-					goto endThread;
-			}
-		endThread:;
-		});
-		// Thread priority is excessively high due to Cycles, so we'll reset it to normal here
-		// util::set_thread_priority(m_ppThreadPool.get_thread(i),util::ThreadPriority::Normal);
+	NotifyPendingWork();
+}
+bool pragma::scenekit::TileManager::ProcessInputTile(size_t tileIndex, TileData &tile)
+{
+	if(m_state == State::Cancelled)
+		return false;
+
+	auto t = GetInstrumentationTimestamp();
+	InitializeTileData(tile);
+	RecordStageLatency(PipelineStage::Ingest, t);
+
+	if(m_state == State::Cancelled)
+		return false;
+
+	TileData prevTile {};
+	auto tileUpdated = false;
+	auto streamTile = false;
+	t = GetInstrumentationTimestamp();
+	m_completedTileMutex.lock();
+	RecordStageLatency(PipelineStage::CompletedTileLockWait, t);
+	// Note: This only shares the tile buffer, the data is copied on write in ApplyPostProcessingForProgressiveTile
+	auto &completedTile = m_completedTiles[tileIndex];
+	if(completedTile.sample == std::numeric_limits<uint16_t>::max() || tile.sample > completedTile.sample) {
+		if(m_convergenceThreshold > 0.f)
+			prevTile = completedTile;
+		completedTile = tile; // Completed tile data is float data WITHOUT color correction (color correction will be applied after denoising)
+		tileUpdated = true;
+		if(m_streamWriter) {
+			// Only the tile metadata is kept, the data goes straight to the streaming output. The convergence estimate
+			// compares consecutive samples of a tile though, so the data has to be kept if it's enabled.
+			if(m_convergenceThreshold <= 0.f)
+				completedTile.data.clear();
+			streamTile = true;
+		}
+		else
+			MarkTileDirty(tileIndex);
+	}
+	m_completedTileMutex.unlock();
+
+	if(!prevTile.data.empty())
+		UpdateTileErrorEstimate(prevTile, tile);
+	if(tileUpdated && m_numPreviewLevels > 0) {
+		PreviewPyramid::SourceTile previewTile {};
+		previewTile.x = tile.x;
+		previewTile.y = tile.y;
+		previewTile.w = tile.w;
+		previewTile.h = tile.h;
+		previewTile.data = tile.data;
+		m_previewPyramid.UpdateTile(previewTile, m_flipHorizontally, m_flipVertically, m_colorTransformProcessor.get());
+	}
+	if(streamTile) {
+		TileStreamWriter::Tile outTile {};
+		outTile.key = tileIndex;
+		outTile.x = tile.x;
+		outTile.y = tile.y;
+		outTile.w = tile.w;
+		outTile.h = tile.h;
+		outTile.sample = tile.sample;
+		outTile.data = tile.data;
+		WriteStreamTile(std::move(outTile));
+	}
+
+	t = GetInstrumentationTimestamp();
+	ApplyPostProcessingForProgressiveTile(tile);
+	RecordStageLatency(PipelineStage::ColorTransform, t);
+	// Progressive tile is HDR 16-bit data WITH color correction (tile will be discarded when rendering is complete and 'm_completedTiles' tile will be used instead)
+	t = GetInstrumentationTimestamp();
+	m_renderedTileMutex.lock();
+	RecordStageLatency(PipelineStage::RenderedTileLockWait, t);
+	if(m_state == State::Cancelled) {
+		m_renderedTileMutex.unlock();
+		return false;
+	}
+	uint32_t curSampleCount = m_renderedSampleCountPerTile.at(tile.index);
+	static uint32_t test = 3;
+	if((tile.sample + 1) >= test) {
+		m_renderedSampleCountPerTile.at(tile.index) = tile.sample + 1;
+		if(curSampleCount == 0)
+			++m_numTilesWithRenderedSamples;
+	}
+
+	PublishRenderedTile(std::move(tile));
+
+	m_renderedTileMutex.unlock();
+	return true;
+}
+void pragma::scenekit::TileManager::UpdateTileErrorEstimate(const TileData &prevTile, const TileData &tile)
+{
+	auto tileIndex = tile.index;
+	if(tileIndex >= m_tileErrors.size() || prevTile.sample == std::numeric_limits<uint16_t>::max() || prevTile.sample >= tile.sample)
+		return;
+	if(prevTile.w != tile.w || prevTile.h != tile.h || !prevTile.IsFloatData() || !tile.IsFloatData())
+		return;
+	auto numPixels = static_cast<size_t>(tile.w) * tile.h;
+	if(numPixels == 0 || prevTile.data.size() < numPixels * sizeof(float) * 4 || tile.data.size() < numPixels * sizeof(float) * 4)
+		return;
+	auto *prevData = reinterpret_cast<const float *>(prevTile.data.data());
+	auto *data = reinterpret_cast<const float *>(tile.data.data());
+	auto getLuminance = [](const float *px) { return 0.2126 * px[0] + 0.7152 * px[1] + 0.0722 * px[2]; };
+	double sumSqDiff = 0.0;
+	double sumLuminance = 0.0;
+	for(size_t i = 0; i < numPixels; ++i) {
+		auto lum = getLuminance(data + i * 4);
+		auto diff = lum - getLuminance(prevData + i * 4);
+		sumSqDiff += diff * diff;
+		sumLuminance += lum;
+	}
+	// Both tiles are running means of the same samples, so Var(mean_s - mean_p) = variance * (1/p - 1/s)
+	auto p = prevTile.sample + 1.0;
+	auto s = tile.sample + 1.0;
+	auto variance = (sumSqDiff / numPixels) / (1.0 / p - 1.0 / s);
+	auto weight = s - p;
+
+	// Reload resets the estimates under the same lock, tiles that have been cancelled in the meantime must not be counted
+	std::scoped_lock lock {m_completedTileMutex};
+	if(m_state == State::Cancelled)
+		return;
+	auto &estimate = m_tileVarianceEstimates[tileIndex];
+	estimate.varianceSum += variance * weight;
+	estimate.weight += weight;
+	variance = estimate.varianceSum / estimate.weight;
+
+	// Standard error of the mean relative to the brightness of the tile, same metric as used by Cycles for adaptive sampling
+	auto meanLuminance = umath::max(sumLuminance / numPixels, 0.0);
+	auto error = std::sqrt(variance / s) / (0.0001 + std::sqrt(meanLuminance));
+	m_tileErrors[tileIndex] = static_cast<float>(error);
+	m_tileErrorSampleCounts[tileIndex] = static_cast<uint32_t>(s);
+}
+void pragma::scenekit::TileManager::SetConvergenceThreshold(float threshold, uint32_t minSamples)
+{
+	m_convergenceThreshold = umath::max(threshold, 0.f);
+	m_convergenceMinSamples = minSamples;
+}
+bool pragma::scenekit::TileManager::IsTileConverged(uint32_t tileIndex) const
+{
+	auto threshold = m_convergenceThreshold.load();
+	if(threshold <= 0.f || tileIndex >= m_tileErrors.size())
+		return false;
+	return m_tileErrorSampleCounts[tileIndex] >= m_convergenceMinSamples && m_tileErrors[tileIndex] <= threshold;
+}
+float pragma::scenekit::TileManager::GetTileError(uint32_t tileIndex) const
+{
+	if(tileIndex >= m_tileErrors.size())
+		return std::numeric_limits<float>::infinity();
+	return m_tileErrors[tileIndex];
+}
+uint32_t pragma::scenekit::TileManager::GetConvergedTileCount() const
+{
+	uint32_t count = 0;
+	for(uint32_t i = 0; i < m_tileErrors.size(); ++i) {
+		if(IsTileConverged(i))
+			++count;
+	}
+	return count;
+}
+void pragma::scenekit::TileManager::MarkTileDirty(size_t tileIndex)
+{
+	m_dirtyTiles[tileIndex] = true;
+	for(auto &buf : m_snapshotBuffers) {
+		if(!buf.dirtyTiles.empty())
+			buf.dirtyTiles[tileIndex] = true;
 	}
 }
+void pragma::scenekit::TileManager::SetStreamingOutput(const std::string &fileName, uint32_t maxPendingTiles)
+{
+	m_streamFileName = fileName;
+	m_streamMaxPendingTiles = maxPendingTiles;
+}
+void pragma::scenekit::TileManager::WriteStreamTile(TileStreamWriter::Tile &&tile)
+{
+	// Workers run on the shared post-processing pool, so they mustn't block if the writer has fallen behind. Tiles that
+	// don't fit into the write buffer are deferred (only the newest sample per tile) and retried by the next worker.
+	std::scoped_lock lock {m_deferredStreamTileMutex};
+	auto it = m_deferredStreamTiles.find(tile.key);
+	if(it == m_deferredStreamTiles.end())
+		m_deferredStreamTiles.insert(std::make_pair(tile.key, std::move(tile)));
+	else if(tile.sample >= it->second.sample)
+		it->second = std::move(tile);
+	for(auto itDeferred = m_deferredStreamTiles.begin(); itDeferred != m_deferredStreamTiles.end();) {
+		if(!m_streamWriter->TryWrite(itDeferred->second))
+			break;
+		itDeferred = m_deferredStreamTiles.erase(itDeferred);
+	}
+}
+void pragma::scenekit::TileManager::FlushDeferredStreamTiles()
+{
+	std::scoped_lock lock {m_deferredStreamTileMutex};
+	for(auto &[key, tile] : m_deferredStreamTiles)
+		m_streamWriter->Write(std::move(tile));
+	m_deferredStreamTiles.clear();
+}
+bool pragma::scenekit::TileManager::FinalizeStreamingOutput()
+{
+	if(!m_streamWriter)
+		return false;
+	StopAndWait();
+	FlushDeferredStreamTiles();
+	auto success = m_streamWriter->Close();
+	if(!success)
+		std::cout << "[TileManager] Failed to write streaming output: " << m_streamWriter->GetError() << std::endl;
+	return success;
+}
 std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::TileManager::UpdateFinalImage()
 {
 	StopAndWait();
+	if(m_streamWriter) {
+		// The image is read back from the streaming output, so it only has to be held in memory once rendering is complete
+		FlushDeferredStreamTiles();
+		m_streamWriter->Flush();
+		std::string err;
+		auto img = TileStreamWriter::ReadImage(m_streamWriter->GetFileName(), err);
+		if(!img) {
+			std::cout << "[TileManager] Failed to read back streaming output: " << err << std::endl;
+			return nullptr;
+		}
+		m_progressiveImage = img;
+		return m_progressiveImage;
+	}
 	constexpr auto verify = false;
+	std::scoped_lock lock {m_completedTileMutex};
+	if(!m_progressiveImage) {
+		m_progressiveImage = uimg::ImageBuffer::Create(m_imageSize.x, m_imageSize.y, uimg::Format::RGBA_FLOAT);
+		std::memset(m_progressiveImage->GetData(), 0, m_progressiveImage->GetSize());
+		std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), true);
+	}
 	auto sample = m_completedTiles.empty() ? -1 : m_completedTiles.front().sample;
-	uint32_t tileIdx = 0;
-	for(auto &tile : m_completedTiles) {
-		ApplyRectData(tile);
+	for(uint32_t tileIdx = 0; auto &tile : m_completedTiles) {
+		// Only tiles that have changed since the last update have to be copied
+		if(m_dirtyTiles[tileIdx]) {
+			ApplyRectData(tile, *m_progressiveImage);
+			m_dirtyTiles[tileIdx] = false;
+		}
 		if constexpr(verify) {
-			if(tileIdx < m_numTiles && tile.sample != sample)
+			if(tile.sample != sample)
 				std::cout << "Sample mismatch: " << sample << "," << tile.sample << std::endl;
-			++tileIdx;
 		}
+		++tileIdx;
 	}
 	return m_progressiveImage;
 }
-void pragma::scenekit::TileManager::ApplyRectData(const TileData &tile)
+std::shared_ptr<uimg::ImageBuffer> pragma::scenekit::TileManager::GetFinalImageSnapshot()
+{
+	if(m_streamWriter)
+		return nullptr;
+	std::scoped_lock snapshotLock {m_snapshotMutex};
+	auto &front = m_snapshotBuffers[m_frontSnapshotBuffer];
+	auto &back = m_snapshotBuffers[1 - m_frontSnapshotBuffer];
+
+	m_completedTileMutex.lock();
+	// The preview snapshots are kept in half precision unless the renderer requested float data
+	auto format = m_useFloatData ? uimg::Format::RGBA_FLOAT : uimg::Format::RGBA_HDR;
+	if(front.image && front.image->GetFormat() != format) {
+		front = {};
+		back = {};
+	}
+	if(!back.image || back.image.use_count() > 1) {
+		// The back buffer doesn't exist yet, or the previous snapshot is still in use by someone,
+		// in which case we mustn't write to it.
+		if(front.image) {
+			back.image = front.image->Copy();
+			back.dirtyTiles = front.dirtyTiles;
+		}
+		else {
+			back.image = uimg::ImageBuffer::Create(m_imageSize.x, m_imageSize.y, format);
+			std::memset(back.image->GetData(), 0, back.image->GetSize());
+			back.dirtyTiles.assign(m_numTiles, true);
+		}
+	}
+	// Tile buffers are never modified after they've been completed, so we can grab
+	// references to them and do the copying without holding the lock.
+	m_snapshotTiles.clear();
+	for(auto i = decltype(m_completedTiles.size()) {0u}; i < m_completedTiles.size(); ++i) {
+		if(!back.dirtyTiles[i])
+			continue;
+		m_snapshotTiles.push_back(m_completedTiles[i]);
+		back.dirtyTiles[i] = false;
+	}
+	m_completedTileMutex.unlock();
+
+	for(auto &tile : m_snapshotTiles)
+		ApplyRectData(tile, *back.image);
+	m_snapshotTiles.clear();
+
+	m_frontSnapshotBuffer = 1 - m_frontSnapshotBuffer;
+	return back.image;
+}
+void pragma::scenekit::TileManager::ApplyRectData(const TileData &tile, uimg::ImageBuffer &imgBuf)
 {
-	if(tile.index == std::numeric_limits<decltype(tile.index)>::max())
+	if(tile.index == std::numeric_limits<decltype(tile.index)>::max() || tile.data.empty())
 		return;
 	auto *srcData = reinterpret_cast<const uint8_t *>(tile.data.data());
-	auto *dstData = static_cast<uint8_t *>(m_progressiveImage->GetData());
-
-	constexpr auto sizePerPixel = sizeof(float) * 4;
-	auto srcSizePerRow = tile.w * sizePerPixel;
-	auto dstSizePerRow = m_progressiveImage->GetWidth() * sizePerPixel;
+	auto *dstData = static_cast<uint8_t *>(imgBuf.GetData());
+
+	constexpr auto numChannels = 4;
+	auto srcSizePerPixel = (tile.IsFloatData() ? sizeof(float) : sizeof(uint16_t)) * numChannels;
+	auto dstSizePerPixel = uimg::ImageBuffer::GetPixelSize(imgBuf.GetFormat());
+	// Float tiles may be written into a half-precision image, in which case they're converted on the fly
+	auto convertToHalf = tile.IsFloatData() && imgBuf.GetFormat() == uimg::Format::RGBA_HDR;
+	if(!convertToHalf && srcSizePerPixel != dstSizePerPixel)
+		return;
+	auto srcSizePerRow = tile.w * srcSizePerPixel;
+	auto dstSizePerRow = imgBuf.GetWidth() * dstSizePerPixel;
 	uint64_t srcOffset = 0;
-	uint64_t dstOffset = (tile.y * m_progressiveImage->GetWidth() + tile.x) * sizePerPixel;
+	uint64_t dstOffset = (tile.y * imgBuf.GetWidth() + tile.x) * dstSizePerPixel;
 	for(auto y = tile.y; y < (tile.y + tile.h); ++y) {
-		std::memcpy(dstData + dstOffset, srcData + srcOffset, tile.w * sizePerPixel);
+		if(convertToHalf)
+			image_kernels::convert_f32_to_f16(reinterpret_cast<const float *>(srcData + srcOffset), reinterpret_cast<uint16_t *>(dstData + dstOffset), tile.w * numChannels);
+		else
+			std::memcpy(dstData + dstOffset, srcData + srcOffset, srcSizePerRow);
 		srcOffset += srcSizePerRow;
 		dstOffset += dstSizePerRow;
 	}
 }
-std::vector<pragma::scenekit::TileManager::TileData> pragma::scenekit::TileManager::GetRenderedTileBatch()
+void pragma::scenekit::TileManager::ClearPendingRenderedTiles()
+{
+	for(auto &tile : m_renderedTileSlots)
+		tile = {};
+	std::fill(m_renderedTileSlotPending.begin(), m_renderedTileSlotPending.end(), false);
+	m_renderedTileRingHead = 0;
+	m_renderedTileRingSize = 0;
+	m_unindexedRenderedTiles.clear();
+}
+void pragma::scenekit::TileManager::PublishRenderedTile(TileData &&tile)
+{
+	auto numSlots = m_renderedTileSlots.size();
+	size_t slot;
+	if(tile.index < numSlots)
+		slot = tile.index;
+	else if(numSlots == 1)
+		slot = 0; // With a single tile, tiles without an index are coalesced like any other tile
+	else {
+		if(m_unindexedRenderedTiles.size() == m_unindexedRenderedTiles.capacity())
+			m_unindexedRenderedTiles.reserve(m_unindexedRenderedTiles.size() * 1.5 + 100);
+		m_unindexedRenderedTiles.push_back(std::move(tile));
+		++m_numPublishedRenderedTiles;
+		return;
+	}
+	if(m_renderedTileSlotPending[slot]) {
+		// The consumer hasn't picked up the previous sample of this tile yet, only the newest one is kept
+		auto &pendingTile = m_renderedTileSlots[slot];
+		if(pendingTile.sample == std::numeric_limits<uint16_t>::max() || tile.sample >= pendingTile.sample) {
+			// The consumer delay is measured from the time the slot became pending
+			tile.timestamp = pendingTile.timestamp;
+			pendingTile = std::move(tile);
+		}
+		++m_numCoalescedRenderedTiles;
+		return;
+	}
+	auto capacity = m_renderedTileRing.size();
+	if(m_renderedTileRingSize == capacity) {
+		// Ring is full, drop the oldest tile
+		auto oldestSlot = m_renderedTileRing[m_renderedTileRingHead];
+		m_renderedTileRingHead = (m_renderedTileRingHead + 1) % capacity;
+		--m_renderedTileRingSize;
+		m_renderedTileSlotPending[oldestSlot] = false;
+		m_renderedTileSlots[oldestSlot] = {};
+		++m_numDroppedRenderedTiles;
+	}
+	m_renderedTileRing[(m_renderedTileRingHead + m_renderedTileRingSize) % capacity] = slot;
+	++m_renderedTileRingSize;
+	m_renderedTileSlotPending[slot] = true;
+	tile.timestamp = GetInstrumentationTimestamp();
+	m_renderedTileSlots[slot] = std::move(tile);
+	++m_numPublishedRenderedTiles;
+}
+const std::vector<pragma::scenekit::TileManager::TileData> &pragma::scenekit::TileManager::PollRenderedTiles()
 {
+	// Releasing the previous batch returns its buffers to the pool
+	m_consumedRenderedTiles.clear();
 	m_renderedTileMutex.lock();
-	auto tiles = std::move(m_renderedTiles);
-	m_renderedTiles.clear();
+	auto capacity = m_renderedTileRing.size();
+	for(auto i = decltype(m_renderedTileRingSize) {0u}; i < m_renderedTileRingSize; ++i) {
+		auto slot = m_renderedTileRing[(m_renderedTileRingHead + i) % capacity];
+		RecordStageLatency(PipelineStage::ConsumerDelay, m_renderedTileSlots[slot].timestamp);
+		m_consumedRenderedTiles.push_back(std::move(m_renderedTileSlots[slot]));
+		m_renderedTileSlots[slot] = {};
+		m_renderedTileSlotPending[slot] = false;
+	}
+	m_renderedTileRingHead = 0;
+	m_renderedTileRingSize = 0;
+	if(m_scheduledTileQueue.GetPolicy() != TileSchedulingPolicy::Fifo) {
+		// Publish the tiles in the same order they're scheduled in
+		std::sort(m_consumedRenderedTiles.begin(), m_consumedRenderedTiles.end(), [this](const TileData &a, const TileData &b) { return m_scheduledTileQueue.GetRank(a.index) < m_scheduledTileQueue.GetRank(b.index); });
+	}
+	for(auto &tile : m_unindexedRenderedTiles)
+		m_consumedRenderedTiles.push_back(std::move(tile));
+	m_unindexedRenderedTiles.clear();
 	m_renderedTileMutex.unlock();
-	return tiles;
+	return m_consumedRenderedTiles;
+}
+void pragma::scenekit::TileManager::ReleaseRenderedTiles() { m_consumedRenderedTiles.clear(); }
+std::vector<pragma::scenekit::TileManager::TileData> pragma::scenekit::TileManager::GetRenderedTileBatch()
+{
+	PollRenderedTiles();
+	std::vector<TileData> batch {std::make_move_iterator(m_consumedRenderedTiles.begin()), std::make_move_iterator(m_consumedRenderedTiles.end())};
+	m_consumedRenderedTiles.clear();
+	return batch;
+}
+void pragma::scenekit::TileManager::SetRenderedTileCapacity(uint32_t capacity)
+{
+	std::scoped_lock lock {m_renderedTileMutex};
+	m_requestedRenderedTileCapacity = capacity;
+	if(m_renderedTileSlots.empty())
+		return; // Applied in Initialize
+	capacity = umath::clamp<uint32_t>(capacity, 1u, m_renderedTileSlots.size());
+	if(capacity == m_renderedTileRing.size())
+		return;
+	m_numDroppedRenderedTiles += m_renderedTileRingSize;
+	auto unindexedTiles = std::move(m_unindexedRenderedTiles);
+	ClearPendingRenderedTiles();
+	m_unindexedRenderedTiles = std::move(unindexedTiles);
+	m_renderedTileRing.assign(capacity, 0);
+}
+pragma::scenekit::TileManager::RenderedTileStats pragma::scenekit::TileManager::GetRenderedTileStats() const
+{
+	RenderedTileStats stats {};
+	stats.numPublished = m_numPublishedRenderedTiles;
+	stats.numCoalesced = m_numCoalescedRenderedTiles;
+	stats.numDropped = m_numDroppedRenderedTiles;
+	return stats;
+}
+void pragma::scenekit::TileManager::ResetRenderedTileStats()
+{
+	m_numPublishedRenderedTiles = 0;
+	m_numCoalescedRenderedTiles = 0;
+	m_numDroppedRenderedTiles = 0;
 }
 
 void pragma::scenekit::TileManager::AddRenderedTile(TileData &&tile)
@@ -229,7 +729,7 @@ void pragma::scenekit::TileManager::AddRenderedTile(TileData &&tile)
 	m_renderedTileMutex.lock();
 	m_numTilesWithRenderedSamples = GetTileCount();
 	; // TODO: This is wrong and will only work if tile count is 1!
-	m_renderedTiles.push_back(std::move(tile));
+	PublishRenderedTile(std::move(tile));
 	m_renderedTileMutex.unlock();
 }
 
@@ -237,6 +737,32 @@ void pragma::scenekit::TileManager::SetFlipImage(bool flipHorizontally, bool fli
 {
 	m_flipHorizontally = flipHorizontally;
 	m_flipVertically = flipVertically;
+	// The region of interest is in image space, but the tile queue operates on tile coordinates
+	if(m_schedulingPolicy == TileSchedulingPolicy::RegionOfInterest)
+		UpdateTileSchedulingPolicy();
+}
+
+void pragma::scenekit::TileManager::SetTileSchedulingPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest)
+{
+	m_schedulingPolicy = policy;
+	m_regionOfInterest = regionOfInterest;
+	UpdateTileSchedulingPolicy();
+}
+
+void pragma::scenekit::TileManager::UpdateTileSchedulingPolicy()
+{
+	auto roi = m_regionOfInterest;
+	if(m_flipHorizontally) {
+		roi.minX = 1.f - m_regionOfInterest.maxX;
+		roi.maxX = 1.f - m_regionOfInterest.minX;
+	}
+	if(m_flipVertically) {
+		roi.minY = 1.f - m_regionOfInterest.maxY;
+		roi.maxY = 1.f - m_regionOfInterest.minY;
+	}
+	// Tile ranks are also read by PollRenderedTiles
+	std::scoped_lock lock {m_inputTileMutex, m_renderedTileMutex};
+	m_scheduledTileQueue.SetPolicy(m_schedulingPolicy, roi);
 }
 
 int32_t pragma::scenekit::TileManager::GetCurrentTileSampleCount(uint32_t tileIndex) const
@@ -252,19 +778,36 @@ void pragma::scenekit::TileManager::InitializeTileData(TileData &data)
 		return;
 	umath::set_flag(data.flags, TileData::Flags::Initialized);
 	if(m_flipHorizontally)
-		data.x = m_progressiveImage->GetWidth() - data.x - data.w;
+		data.x = m_imageSize.x - data.x - data.w;
 	if(m_flipVertically)
-		data.y = m_progressiveImage->GetHeight() - data.y - data.h;
-
-	auto img = uimg::ImageBuffer::Create(data.data.data(), data.w, data.h, uimg::Format::RGBA_FLOAT);
-	img->Flip(m_flipHorizontally, m_flipVertically);
-	img->ClearAlpha(uimg::ImageBuffer::FULLY_OPAQUE);
+		data.y = m_imageSize.y - data.y - data.h;
+
+	// Flip and alpha clear are fused into a single pass over the tile
+	image_kernels::TileIngestInfo ingestInfo {};
+	ingestInfo.width = data.w;
+	ingestInfo.height = data.h;
+	ingestInfo.flipHorizontally = m_flipHorizontally;
+	ingestInfo.flipVertically = m_flipVertically;
+	auto *tileData = reinterpret_cast<float *>(data.data.data());
+	image_kernels::ingest_tile(tileData, tileData, ingestInfo);
 }
 
 void pragma::scenekit::TileManager::ApplyPostProcessingForProgressiveTile(TileData &data)
 {
+	if(!m_useFloatData && data.IsFloatData()) {
+		// Progressive tiles are converted to half precision. Since the converted data is written
+		// into a new buffer, this also detaches the tile from the completed tile.
+		TileBuffer halfData {m_tileBufferPool};
+		auto numValues = static_cast<size_t>(data.w) * data.h * 4;
+		halfData.resize(numValues * sizeof(uint16_t));
+		image_kernels::convert_f32_to_f16(reinterpret_cast<const float *>(data.data.data()), reinterpret_cast<uint16_t *>(halfData.data()), numValues);
+		data.data = std::move(halfData);
+		umath::set_flag(data.flags, TileData::Flags::HDRData);
+	}
 	if(!m_colorTransformProcessor)
 		return;
+	// The tile data may still be referenced by the completed tiles, which must not be color corrected
+	data.data.MakeUnique();
 	auto img = uimg::ImageBuffer::Create(data.data.data(), data.w, data.h, data.IsFloatData() ? uimg::Format::RGBA_FLOAT : uimg::Format::RGBA_HDR);
 	std::string err;
 	auto result = m_colorTransformProcessor->Apply(*img, err);
@@ -25,6 +25,7 @@ namespace util::ocio {
 };
 namespace oidn {
 	class DeviceRef;
+	class FilterRef;
 };
 
 namespace ccl {
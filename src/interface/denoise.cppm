@@ -10,18 +10,52 @@ export module pragma.scenekit:denoise;
 export import pragma.image;
 
 export namespace pragma::scenekit::denoise {
+	enum class Quality : uint8_t {
+		Default = 0, // Whatever OIDN defaults to (highest quality)
+		Fast,        // Requires OIDN 2.2, falls back to Balanced on older versions
+		Balanced,    // Requires OIDN 2.0
+		High,
+	};
 	struct DLLRTUTIL Info {
-		uint32_t numThreads = 16;
+		uint32_t numThreads = 16; // Maximum number of threads used by CPU devices, 0 to use all hardware threads
 		uint32_t width = 0;
 		uint32_t height = 0;
 		bool lightmap = false;
 		bool hdr = true;
+		bool setAffinity = false; // Pins the threads of CPU devices to hardware threads
+		Quality quality = Quality::Default;
+
+		// If set, the image is denoised in tiles of at most tileSize x tileSize pixels. Every tile is extended by tileOverlap
+		// pixels of context on each side, and neighboring tiles are blended linearly across the seams.
+		uint32_t tileSize = 0;
+		uint32_t tileOverlap = 64;
+		// Approximate upper limit for the memory used by the denoiser in megabytes, 0 for no limit.
+		// If the full image exceeds the limit, tiled denoising is used even if no tile size was specified.
+		// If tiled denoising fails or is cancelled, parts of the output may already have been written.
+		uint32_t maxMemoryMB = 0;
+		// Debugging option: If tiled denoising is used, the full image is denoised as well and the maximum relative deviation
+		// of the tiled result is reported (as a warning if it exceeds the tolerance). The full image ignores the memory limit.
+		bool verifyTiling = false;
+		float tilingTolerance = 0.02f;
 	};
 
+	// Only the first three channels are read and written, any additional channels (e.g. alpha) are left untouched.
+	// Strides are in bytes, 0 means tightly packed.
 	struct DLLRTUTIL ImageData {
 		uint8_t *data = nullptr;
 		uimg::Format format = uimg::Format::RGB32;
+		uint32_t pixelStride = 0;
+		uint32_t rowStride = 0;
+
+		uint32_t GetPixelStride() const;
+		uint32_t GetRowStride(uint32_t width) const;
+		// Returns a view of the region starting at (x, y), with the strides of this image. The size of the view is
+		// determined by the denoise::Info it is used with.
+		ImageData GetSubView(uint32_t width, uint32_t x, uint32_t y) const;
+		uint8_t *GetPixel(uint32_t width, uint32_t x, uint32_t y) const;
 	};
+	// Returns a view of the image buffer, or of the region starting at (x, y) of it
+	DLLRTUTIL ImageData create_image_view(uimg::ImageBuffer &imgBuffer, uint32_t x = 0, uint32_t y = 0);
 	struct DLLRTUTIL ImageInputs {
 		ImageData beautyImage;
 		ImageData albedoImage;
@@ -33,8 +67,72 @@ export namespace pragma::scenekit::denoise {
 		Denoiser();
 		bool Denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback = nullptr);
 	  private:
-		std::shared_ptr<oidn::DeviceRef> m_device = nullptr;
+		std::shared_ptr<oidn::DeviceRef> m_device = nullptr; // Device of the last call, matching its thread configuration
 	};
+
+	// Long-lived denoiser that keeps the OIDN device and committed filters alive between calls.
+	// Filters are cached by their configuration (filter type, resolution, formats and aux inputs), so repeated denoising
+	// of images with the same layout only has to re-bind the image buffers. Thread-safe, concurrent calls with the same
+	// configuration use separate filters.
+	class DLLRTUTIL DenoiseService {
+	  public:
+		static DenoiseService &GetInstance();
+		~DenoiseService();
+		bool Denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback = nullptr);
+		// Maximum number of idle filters to keep, least recently used filters are released first
+		void SetMaxCachedFilterCount(uint32_t count);
+		size_t GetCachedFilterCount() const;
+		// Keeps additional idle filters cached until the reservation is released, e.g. while a batch of images with many different
+		// configurations is denoised concurrently (like the charts of a lightmap atlas), so the batch doesn't evict its own filters.
+		void ReserveCachedFilters(uint32_t count);
+		void ReleaseCachedFilterReservation(uint32_t count);
+		// Releases all idle filters and the devices, if they aren't in use
+		void Clear();
+
+		// Devices are cached per thread configuration
+		std::shared_ptr<oidn::DeviceRef> GetDevice(uint32_t numThreads = 0, bool setAffinity = false);
+	  private:
+		struct DeviceKey {
+			uint32_t numThreads = 0;
+			bool setAffinity = false;
+			bool operator==(const DeviceKey &other) const = default;
+		};
+		struct FilterKey {
+			DeviceKey device;
+			Quality quality = Quality::Default;
+			bool lightmap = false;
+			bool hdr = true;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uimg::Format colorFormat = uimg::Format::RGB32;
+			std::optional<uimg::Format> albedoFormat {};
+			std::optional<uimg::Format> normalFormat {};
+			uimg::Format outputFormat = uimg::Format::RGB32;
+			uint32_t maxMemoryMB = 0;
+			bool operator==(const FilterKey &other) const = default;
+		};
+		struct CachedFilter {
+			FilterKey key;
+			std::shared_ptr<oidn::DeviceRef> device;
+			std::shared_ptr<oidn::FilterRef> filter;
+			std::mutex mutex;
+			uint64_t lastUsed = 0;
+		};
+		DenoiseService() = default;
+		std::shared_ptr<CachedFilter> AcquireFilter(const FilterKey &key);
+		bool DenoiseImage(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback);
+		std::shared_ptr<oidn::DeviceRef> FindOrCreateDevice(const DeviceKey &key);
+		void TrimCache(size_t maxFilters);
+
+		mutable std::mutex m_mutex;
+		std::vector<std::pair<DeviceKey, std::shared_ptr<oidn::DeviceRef>>> m_devices;
+		std::vector<std::shared_ptr<CachedFilter>> m_filters;
+		uint32_t m_maxCachedFilters = 8;
+		uint32_t m_numReservedFilters = 0;
+		uint64_t m_useCounter = 0;
+	};
+
+	// Denoises the image using the shared DenoiseService
 	DLLRTUTIL bool denoise(const Info &denoise, const ImageInputs &inputImages, const ImageData &outputImage, const std::function<bool(float)> &fProgressCallback = nullptr);
 	DLLRTUTIL bool denoise(const Info &denoise, uimg::ImageBuffer &imgBuffer, uimg::ImageBuffer *optImgBufferAlbedo = nullptr, uimg::ImageBuffer *optImgBufferNormal = nullptr, const std::function<bool(float)> &fProgressCallback = nullptr);
 };
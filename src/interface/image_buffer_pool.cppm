@@ -0,0 +1,64 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:image_buffer_pool;
+
+export import pragma.image;
+
+export namespace pragma::scenekit {
+	// Process-wide pool of image buffers, keyed by resolution and format. Acquired buffers are returned to the pool automatically
+	// once their last reference has been released, so consecutive renders with the same resolution and passes don't have to
+	// allocate their result buffers again. Idle buffers are limited by the memory cap; if a returned buffer doesn't fit, idle
+	// buffers of other resolutions/formats are evicted first.
+	class DLLRTUTIL ImageBufferPool {
+	  public:
+		static constexpr size_t DEFAULT_MEMORY_CAP = 2ull * 1'024 * 1'024 * 1'024; // 2 GiB
+		static ImageBufferPool &GetInstance();
+
+		// The contents of acquired buffers are undefined
+		std::shared_ptr<uimg::ImageBuffer> Acquire(uint32_t width, uint32_t height, uimg::Format format);
+		// Allocates idle buffers ahead of time, e.g. before the first frame of an animation
+		void Preallocate(uint32_t width, uint32_t height, uimg::Format format, uint32_t count);
+		void Clear();
+
+		void SetMemoryCap(size_t capInBytes);
+		size_t GetMemoryCap() const;
+		// If enabled, every page of newly allocated buffers is touched once, so the page faults don't occur while rendering
+		void SetPrefaultEnabled(bool enabled);
+		bool IsPrefaultEnabled() const;
+
+		size_t GetIdleMemory() const;
+		uint64_t GetHitCount() const;
+		uint64_t GetMissCount() const;
+	  private:
+		struct Key {
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uimg::Format format {};
+			bool operator==(const Key &other) const { return width == other.width && height == other.height && format == other.format; }
+		};
+		struct KeyHasher {
+			size_t operator()(const Key &key) const;
+		};
+		// Shared with the deleters of acquired buffers, which may outlive the pool
+		struct State {
+			mutable std::mutex mutex;
+			std::unordered_map<Key, std::vector<std::shared_ptr<uimg::ImageBuffer>>, KeyHasher> idleBuffers;
+			size_t idleMemory = 0;
+			size_t memoryCap = DEFAULT_MEMORY_CAP;
+			bool prefault = false;
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			void Return(const Key &key, const std::shared_ptr<uimg::ImageBuffer> &buffer);
+			void Evict(size_t requiredSize, const Key *optKeep);
+		};
+		ImageBufferPool();
+		static std::shared_ptr<uimg::ImageBuffer> Allocate(const Key &key, bool prefault);
+		std::shared_ptr<uimg::ImageBuffer> Wrap(const Key &key, const std::shared_ptr<uimg::ImageBuffer> &buffer);
+		std::shared_ptr<State> m_state;
+	};
+};
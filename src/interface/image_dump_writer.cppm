@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:image_dump_writer;
+
+export import pragma.image;
+
+export namespace pragma::scenekit {
+	// Encodes and writes debug images on a background thread, so dumping doesn't stall the render thread.
+	// Dumps are queued in a buffer that is bounded by the size of the pending images, if the buffer is full new dumps are dropped
+	// (and reported) instead of blocking.
+	// The thread is started with the first dump, pending dumps are always written before the writer is destroyed.
+	class DLLRTUTIL ImageDumpWriter {
+	  public:
+		ImageDumpWriter(size_t maxPendingBytes);
+		~ImageDumpWriter();
+		// Copies the image, returns false if the dump has been dropped
+		bool Write(const std::string &fileName, const uimg::ImageBuffer &imgBuf, uimg::ImageFormat format);
+		// Takes ownership of the snapshot, which must not be modified afterwards. Dropped snapshots are released immediately.
+		bool Write(const std::string &fileName, std::shared_ptr<uimg::ImageBuffer> &&snapshot, uimg::ImageFormat format);
+		// Blocks until all queued dumps have been written
+		void Flush();
+		void Close();
+		size_t GetPendingDumpCount() const;
+		uint64_t GetWrittenDumpCount() const { return m_numWrittenDumps; }
+		uint64_t GetDroppedDumpCount() const { return m_numDroppedDumps; }
+	  private:
+		struct Dump {
+			std::string fileName;
+			std::shared_ptr<uimg::ImageBuffer> image;
+			uimg::ImageFormat format;
+			size_t size = 0;
+		};
+		// Reserves a slot in the queue, so the image can be copied without holding the lock
+		bool ReserveSlot(const std::string &fileName, size_t size);
+		void Enqueue(Dump &&dump);
+		void Run();
+		static bool WriteDump(const Dump &dump);
+
+		size_t m_maxPendingBytes = 0;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_pendingCondition;
+		std::condition_variable m_writtenCondition;
+		std::deque<Dump> m_pendingDumps;
+		uint32_t m_numReservedSlots = 0;
+		size_t m_pendingBytes = 0; // Including reserved slots
+		bool m_writing = false;
+		bool m_closing = false;
+		uint64_t m_numDroppedSinceReport = 0;
+		std::atomic<uint64_t> m_numWrittenDumps = 0;
+		std::atomic<uint64_t> m_numDroppedDumps = 0;
+		std::thread m_thread;
+	};
+};
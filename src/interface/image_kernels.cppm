@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:image_kernels;
+
+export import std;
+
+// Vectorized helper kernels for RGBA float image data. SSE2/AVX2 code paths are selected at compile time,
+// with a scalar fallback for all other targets.
+export namespace pragma::scenekit::image_kernels {
+	struct DLLRTUTIL TileIngestInfo {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		bool flipHorizontally = false;
+		bool flipVertically = false;
+	};
+	// Flips the RGBA float tile and forces the alpha channel to 1 in a single pass.
+	// src and dst may point to the same memory.
+	DLLRTUTIL void ingest_tile(const float *src, float *dst, const TileIngestInfo &info);
+
+	// Converts 32-bit floats to IEEE 754 half-precision floats (round-to-nearest-even), using F16C if available
+	DLLRTUTIL void convert_f32_to_f16(const float *src, uint16_t *dst, size_t count);
+
+	// Writes 1 for every RGBA float pixel with an alpha value > 0 and 0 otherwise. Returns the number of covered pixels.
+	DLLRTUTIL size_t compute_alpha_coverage(const float *src, uint8_t *dstMask, size_t numPixels);
+};
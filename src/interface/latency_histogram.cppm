@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:latency_histogram;
+
+export import std;
+
+export namespace pragma::scenekit {
+	// Lock-free histogram of durations in nanoseconds with power-of-two buckets.
+	// Bucket i contains all samples in [2^i, 2^(i+1)), samples that exceed the last bucket are added to it.
+	class DLLRTUTIL LatencyHistogram {
+	  public:
+		static constexpr uint32_t BUCKET_COUNT = 36; // Last bucket starts at ~34 seconds
+		static uint64_t GetBucketLowerBound(uint32_t bucket) { return (bucket == 0) ? 0 : (uint64_t {1} << bucket); }
+		static uint64_t GetTimestamp();
+
+		void Record(uint64_t durationNs);
+		void Reset();
+		uint64_t GetCount() const { return m_count.load(std::memory_order_relaxed); }
+		uint64_t GetTotal() const { return m_total.load(std::memory_order_relaxed); }
+		uint64_t GetMax() const { return m_max.load(std::memory_order_relaxed); }
+		double GetMean() const;
+		uint64_t GetBucketCount(uint32_t bucket) const { return m_buckets[bucket].load(std::memory_order_relaxed); }
+		// Returns the upper bound of the bucket that contains the specified percentile [0,1]
+		uint64_t GetPercentile(double percentile) const;
+	  private:
+		std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets {};
+		std::atomic<uint64_t> m_count = 0;
+		std::atomic<uint64_t> m_total = 0;
+		std::atomic<uint64_t> m_max = 0;
+	};
+};
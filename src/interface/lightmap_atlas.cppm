@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:lightmap_atlas;
+
+export import :denoise;
+
+export namespace pragma::scenekit::denoise {
+	// Occupied region of a lightmap atlas. Neighboring UV islands are merged into a single chart if their padded bounds
+	// overlap, so the padded bounds of all charts are disjoint.
+	struct DLLRTUTIL AtlasChart {
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t w = 0;
+		uint32_t h = 0;
+		uint32_t numTexels = 0;
+		uint64_t denoiseTime = 0; // Nanoseconds
+	};
+	// Detects the charts of an RGBA float lightmap atlas from its alpha coverage (alpha > 0). If optOutChartMap is
+	// specified, it receives the chart index + 1 of every texel, or 0 for unoccupied texels.
+	DLLRTUTIL std::vector<AtlasChart> find_atlas_charts(const uimg::ImageBuffer &imgBuffer, uint32_t padding, std::vector<uint32_t> *optOutChartMap = nullptr);
+
+	// Denoises every chart of the atlas separately with the lightmap filter, charts are processed concurrently.
+	// Only occupied texels are written back, the alpha channel and unoccupied texels are left untouched.
+	// If the image is not an RGBA float image, or has no alpha coverage, the whole image is denoised instead.
+	DLLRTUTIL bool denoise_atlas(const Info &denoise, uimg::ImageBuffer &imgBuffer, std::vector<AtlasChart> *optOutCharts = nullptr, const std::function<bool(float)> &fProgressCallback = nullptr);
+};
@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:post_processing_pool;
+
+export import pragma.util;
+
+export namespace pragma::scenekit {
+	class TileManager;
+	// Process-wide executor for post-processing work. All tile managers share its threads, and each
+	// tile manager may only occupy a share of the concurrency budget proportional to its weight.
+	class DLLRTUTIL PostProcessingPool {
+	  public:
+		static PostProcessingPool &GetInstance();
+		static uint32_t GetDefaultConcurrency();
+
+		void SetConcurrency(uint32_t concurrency);
+		uint32_t GetConcurrency() const;
+
+		void SetClientWeight(const TileManager &client, float weight);
+		void RemoveClient(const TileManager &client);
+		uint32_t GetWorkerBudget(const TileManager &client) const;
+
+		std::future<void> Submit(const std::function<void()> &task);
+	  private:
+		PostProcessingPool();
+		mutable std::mutex m_mutex;
+		std::unordered_map<const TileManager *, float> m_clientWeights;
+		float m_totalWeight = 0.f;
+		uint32_t m_concurrency = 0;
+		ctpl::thread_pool m_threadPool;
+	};
+};
@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:preview_denoiser;
+
+export import :denoise;
+export import :tile_manager;
+
+export namespace pragma::scenekit {
+	// Periodically denoises a snapshot of the progressive image of a tile manager on a background thread and publishes the
+	// result as a separate preview image. A new snapshot is taken whenever the interval has elapsed, the lowest tile sample
+	// count has reached the next sample milestone, or a preview has been requested explicitly. If a new snapshot is due
+	// while a preview is still being denoised, the stale job is cancelled (interval ticks don't cancel running jobs).
+	// The tile manager has to outlive the preview denoiser and must not be re-initialized while the preview denoiser is running.
+	class DLLRTUTIL PreviewDenoiser {
+	  public:
+		struct Settings {
+			std::chrono::milliseconds interval {2'000}; // 0 to disable periodic previews
+			uint32_t sampleMilestone = 0;                // If > 0, a preview is also denoised every time the lowest tile sample count reaches a multiple of this
+			denoise::Quality quality = denoise::Quality::Fast;
+			uint32_t numThreads = 2; // Keep this low, the render threads have priority
+		};
+		PreviewDenoiser(TileManager &tileManager);
+		~PreviewDenoiser();
+		void Start(const Settings &settings = {});
+		void Stop();
+		bool IsRunning() const { return m_thread.joinable(); }
+		// Denoises a new snapshot as soon as possible, cancels the preview that is currently being denoised
+		void RequestPreview();
+
+		// Returns the most recent denoised preview, which must be treated as read-only, or nullptr if there is none yet
+		std::shared_ptr<uimg::ImageBuffer> GetPreview() const;
+		// Incremented every time a new preview has been published
+		uint64_t GetPreviewVersion() const { return m_previewVersion; }
+		// Called from the denoising thread whenever a new preview has been published
+		void SetPreviewCallback(const std::function<void(const std::shared_ptr<uimg::ImageBuffer> &)> &callback);
+	  private:
+		uint32_t GetLowestTileSampleCount() const;
+		bool IsMilestoneReached() const;
+		bool IsJobStale(uint64_t request) const;
+		void Run();
+
+		TileManager &m_tileManager;
+		Settings m_settings {};
+		std::thread m_thread;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::atomic<bool> m_stopping = false;
+		std::atomic<uint64_t> m_requestCounter = 0;
+		uint32_t m_lastMilestone = 0;
+		std::shared_ptr<uimg::ImageBuffer> m_preview = nullptr;
+		std::atomic<uint64_t> m_previewVersion = 0;
+		std::function<void(const std::shared_ptr<uimg::ImageBuffer> &)> m_previewCallback = nullptr;
+	};
+};
@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:preview_pyramid;
+
+export import pragma.image;
+import pragma.ocio;
+
+export import :tile_buffer;
+
+export namespace pragma::scenekit {
+	// Downscaled copies of the progressive image. Level n has 1/2^n of the image resolution (rounded up), level 0 (the
+	// full resolution image) is not part of the pyramid. Levels are box-filtered in linear space and only the texels
+	// affected by a tile are updated whenever a tile changes. Thread-safe, tiles are filtered without holding a lock and
+	// every level has its own lock. Levels are locked hand-over-hand, so concurrent updates are applied in the same order on all levels.
+	class DLLRTUTIL PreviewPyramid {
+	  public:
+		// Linear RGBA float tile data in image space
+		struct SourceTile {
+			uint16_t x = 0;
+			uint16_t y = 0;
+			uint16_t w = 0;
+			uint16_t h = 0;
+			TileBuffer data;
+		};
+		// If keepSourceTiles is false, texels that straddle a tile boundary are only averaged over the tile that was updated last.
+		void Initialize(uint32_t width, uint32_t height, uint32_t tileWidth, uint32_t tileHeight, uint32_t numLevels, uimg::Format format, bool keepSourceTiles);
+		void Clear();
+		uint32_t GetLevelCount() const;
+		// Returns the smallest level that is still at least as large as the specified size, or 0 if there is none
+		uint32_t FindLevel(uint32_t width, uint32_t height) const;
+		// Returns a copy of the specified level (starting at 1)
+		std::shared_ptr<uimg::ImageBuffer> GetLevel(uint32_t level) const;
+
+		// The flip flags determine the position of the tile grid in image space
+		void UpdateTile(const SourceTile &tile, bool flipHorizontally, bool flipVertically, pragma::ocio::ColorProcessor *optColorProcessor = nullptr);
+	  private:
+		struct Region {
+			uint32_t x0 = 0;
+			uint32_t y0 = 0;
+			uint32_t x1 = 0;
+			uint32_t y1 = 0;
+		};
+		struct Level {
+			uint32_t width = 0;
+			uint32_t height = 0;
+			std::unique_ptr<std::mutex> mutex;
+			std::vector<float> linearData; // RGBA float, before color transform
+			std::shared_ptr<uimg::ImageBuffer> image;
+		};
+		// Box-filtered texels of a region, texels without any source pixels are not written
+		struct RegionData {
+			Region region {};
+			std::vector<float> texels; // RGBA float
+			std::vector<bool> valid;
+			void Reset(const Region &region);
+		};
+		size_t GetTileGridIndex(uint32_t x, uint32_t y, bool flipHorizontally, bool flipVertically) const;
+		// Has to be called with the lock of the level held
+		void UpdateImageRegion(Level &level, const Region &region, pragma::ocio::ColorProcessor *optColorProcessor, std::vector<float> &transformBuffer) const;
+
+		// Guards the structure of the pyramid (levels and dimensions), the level contents are guarded by the level locks
+		mutable std::shared_mutex m_mutex;
+		std::mutex m_sourceTileMutex;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uimg::Format m_format = uimg::Format::RGBA_FLOAT;
+		bool m_keepSourceTiles = false;
+		uint32_t m_tileWidth = 0;
+		uint32_t m_tileHeight = 0;
+		uint32_t m_numTilesX = 0;
+		std::vector<SourceTile> m_sourceTiles; // By tile grid position in image space
+		std::vector<Level> m_levels;
+	};
+};
@@ -9,6 +9,12 @@ module;
 export module pragma.scenekit:renderer;
 
 import :tile_manager;
+import :lightmap_atlas;
+import :preview_denoiser;
+import :temporal_denoiser;
+import :scene_object;
+import :image_buffer_pool;
+import :image_dump_writer;
 export import pragma.udm;
 
 export namespace pragma::scenekit {
@@ -130,6 +136,33 @@ export namespace pragma::scenekit {
 		TileManager &GetTileManager() { return m_tileManager; }
 		const TileManager &GetTileManager() const { return const_cast<Renderer *>(this)->GetTileManager(); }
 		std::vector<pragma::scenekit::TileManager::TileData> GetRenderedTileBatch();
+		const std::vector<pragma::scenekit::TileManager::TileData> &PollRenderedTiles();
+		void SetTileSchedulingPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest = {});
+		TileSchedulingPolicy GetTileSchedulingPolicy() const;
+		// Writes the latency histograms of the tile pipeline stages to the specified element. Instrumentation is enabled with
+		// the "debug/instrumentTilePipeline" api data flag and the statistics are reset whenever a new render is started.
+		void GetTilePipelineStats(udm::LinkedPropertyWrapper &outData) const;
+		void ResetTilePipelineStats();
+		// Writes the latency histogram of the FinalizeImage render stage (color transform, alpha and FinalizeImage for all passes).
+		// Passes are finalized in parallel if the renderer supports it (see IsFinalizeImageThreadSafe), unless the
+		// "debug/finalizeImagesSerially" api data flag is set.
+		void GetFinalizeImageStats(udm::LinkedPropertyWrapper &outData) const;
+		void ResetFinalizeImageStats();
+		// Number of render stage image dumps that have been dropped because the dump queue was full
+		uint64_t GetDroppedImageDumpCount() const { return m_imageDumpWriter.GetDroppedDumpCount(); }
+		// Writes the chart regions and per-chart denoising times (in nanoseconds) of the last lightmap bake to the specified element
+		void GetLightmapDenoiseStats(udm::LinkedPropertyWrapper &outData) const;
+		// Denoises snapshots of the progressive image in the background while rendering (see PreviewDenoiser).
+		// Has to be started after the tile manager has been initialized, it is stopped automatically before the final denoising stage.
+		void StartPreviewDenoising(const PreviewDenoiser::Settings &settings = {});
+		void StopPreviewDenoising();
+		std::shared_ptr<uimg::ImageBuffer> GetDenoisedPreview() const;
+		uint64_t GetDenoisedPreviewVersion() const;
+		// If set, the main pass is denoised with the temporal denoiser, which keeps its history across renderers. Use the same denoiser
+		// for all frames of an image sequence. The depth pass is added automatically if the position pass isn't rendered, stereoscopic
+		// images are denoised per frame.
+		void SetTemporalDenoiser(const std::shared_ptr<denoise::TemporalDenoiser> &denoiser) { m_temporalDenoiser = denoiser; }
+		const std::shared_ptr<denoise::TemporalDenoiser> &GetTemporalDenoiser() const { return m_temporalDenoiser; }
 		void AddActorToActorMap(WorldObject &obj);
 
 		const std::unordered_map<PassType, std::array<std::shared_ptr<uimg::ImageBuffer>, umath::to_integral(StereoEye::Count)>> &GetResultImageBuffers() const { return m_resultImageBuffers; }
@@ -164,10 +197,30 @@ export namespace pragma::scenekit {
 		virtual bool UpdateStereoEye(pragma::scenekit::RenderWorker &worker, pragma::scenekit::Renderer::ImageRenderStage stage, StereoEye &eyeStage) = 0;
 		virtual void SetCancelled(const std::string &msg = "Cancelled by application.") = 0;
 		virtual void CloseRenderScene() = 0;
+		// Called concurrently for the result images of different passes if IsFinalizeImageThreadSafe returns true
 		virtual void FinalizeImage(uimg::ImageBuffer &imgBuf, StereoEye eyeStage) {};
+		// Renderers whose FinalizeImage can be called concurrently can opt into finalizing the passes in parallel
+		virtual bool IsFinalizeImageThreadSafe() const { return false; }
+		void FinalizeResultImages(StereoEye eyeStage);
 		void UpdateActorMap();
+		// Renderers that write the results of both eyes into the existing result buffers of the main pass can opt into rendering into a
+		// single composite image by returning the format of the pass, which saves the copy in the MergeStereoscopic stage.
+		virtual std::optional<uimg::Format> GetStereoCompositeFormat(PassType type) const { return {}; }
+		// Allocates a single image for both eyes and sets the result buffers of the eyes to views into its halves
+		void AllocateStereoCompositeImage(PassType type, uint32_t width, uint32_t height, uimg::Format format);
+		// Releases the composite image and clears all result buffers that are views into it
+		void ReleaseStereoCompositeImage();
+		bool ShouldDenoiseStereoEyesConcurrently() const;
+		void WaitForStereoEyeDenoising();
+		void UpdateLookupTables();
+		void AddToLookupTables(Object &obj);
 		std::pair<uint32_t, PassType> AddPass(PassType passType);
+		// Dumps beyond this amount of pending image data are dropped until the writer has caught up
+		static constexpr size_t MAX_PENDING_IMAGE_DUMP_MEMORY = 1'024ull * 1'024 * 1'024; // 1 GiB
+		// Dumps are written asynchronously (see ImageDumpWriter), the image is copied
 		void DumpImage(const std::string &renderStage, uimg::ImageBuffer &imgBuffer, uimg::ImageFormat format = uimg::ImageFormat::HDR, const std::optional<std::string> &fileName = {}) const;
+		// Takes ownership of the snapshot, which must not be modified afterwards
+		void DumpImage(const std::string &renderStage, std::shared_ptr<uimg::ImageBuffer> &&snapshot, uimg::ImageFormat format = uimg::ImageFormat::HDR, const std::optional<std::string> &fileName = {}) const;
 		bool ShouldDumpRenderStageImages() const;
 
 		std::shared_ptr<Scene> m_scene = nullptr;
@@ -185,13 +238,33 @@ export namespace pragma::scenekit {
 		std::mutex m_progressiveMutex {};
 		std::shared_ptr<pragma::ocio::ColorProcessor> m_colorTransformProcessor = nullptr;
 		std::unordered_map<size_t, pragma::scenekit::WorldObject *> m_actorMap;
+		// Lookup tables for FindRenderMeshByHash and FindObject. If multiple meshes or objects share a hash or name, the first one is used.
+		// Live actors may be added while other threads look up objects, so the tables are guarded by m_lookupTableMutex.
+		mutable std::shared_mutex m_lookupTableMutex;
+		std::unordered_map<util::MurmurHash3, std::shared_ptr<Mesh>, MurmurHash3Hasher> m_meshHashMap;
+		std::unordered_map<std::string, Object *> m_objectNameMap;
 
 		std::shared_ptr<uimg::ImageBuffer> &GetResultImageBuffer(PassType type, StereoEye eye = StereoEye::Left);
 		uimg::ImageBuffer *FindResultImageBuffer(PassType type, StereoEye eye = StereoEye::Left);
+		// Returns the result buffer of the pass, which is drawn from the image buffer pool (see ImageBufferPool) if it hasn't been
+		// created yet. The current buffer is kept if it matches and isn't referenced anywhere else. Renderers should use this instead
+		// of assigning new buffers, the contents of newly drawn buffers are undefined.
+		std::shared_ptr<uimg::ImageBuffer> &GetResultImageBuffer(PassType type, uint32_t width, uint32_t height, uimg::Format format, StereoEye eye = StereoEye::Left);
+		// Returns all result buffers to the image buffer pool once they're no longer referenced, called by PrepareCyclesSceneForRendering
+		void ReleaseResultImageBuffers();
 		std::unordered_map<PassType, std::array<std::shared_ptr<uimg::ImageBuffer>, umath::to_integral(StereoEye::Count)>> m_resultImageBuffers = {};
 
 		std::unordered_map<PassType, uint32_t> m_passes {};
 		uint32_t m_nextOutputIndex = 0;
+
+		mutable std::mutex m_lightmapDenoiseStatsMutex {};
+		std::unordered_map<PassType, std::vector<denoise::AtlasChart>> m_lightmapDenoiseStats;
+		PreviewDenoiser m_previewDenoiser {m_tileManager};
+		std::shared_ptr<denoise::TemporalDenoiser> m_temporalDenoiser = nullptr;
+		std::weak_ptr<uimg::ImageBuffer> m_stereoCompositeImage {}; // Owned by the eye views
+		mutable ImageDumpWriter m_imageDumpWriter {MAX_PENDING_IMAGE_DUMP_MEMORY};
+		std::future<void> m_stereoEyeDenoiseJob;
+		LatencyHistogram m_finalizeImageLatency;
 	};
 	using namespace umath::scoped_enum::bitwise;
 };
@@ -11,6 +11,8 @@ export module pragma.scenekit:scene;
 export import pragma.image;
 export import pragma.udm;
 
+import :denoise;
+
 export namespace pragma::scenekit {
 	class GroupNodeDesc;
 	class SceneObject;
@@ -235,6 +237,8 @@ export namespace pragma::scenekit {
 
 		DenoiseMode GetDenoiseMode() const { return m_createInfo.denoiseMode; }
 		bool ShouldDenoise() const { return GetDenoiseMode() != DenoiseMode::None; }
+		// Denoiser quality preset for the denoise mode
+		denoise::Quality GetDenoiseQuality() const;
 		float GetGamma() const;
 
 		std::unordered_map<size_t, WorldObject *> BuildActorMap() const;
@@ -11,6 +11,9 @@ export import pragma.util;
 
 export namespace pragma::scenekit {
 	class Scene;
+	struct DLLRTUTIL MurmurHash3Hasher {
+		std::size_t operator()(const util::MurmurHash3 &hash) const;
+	};
 	class DLLRTUTIL BaseObject {
 	  public:
 		BaseObject();
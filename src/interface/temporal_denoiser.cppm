@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:temporal_denoiser;
+
+export import :denoise;
+export import pragma.udm;
+
+export namespace pragma::scenekit::denoise {
+	// Denoiser for image sequences. Every frame is denoised spatially first, then the denoised output of the previous frame is
+	// reprojected into the current frame and blended with it, which reduces flickering between frames.
+	// Reprojection uses the world positions from the position pass, or reconstructs them from the depth pass (planar depth) and
+	// the camera. History samples are rejected if their depth or normal doesn't match (disocclusion) and are clamped to the
+	// color range of the current neighborhood to limit ghosting of moving objects.
+	// Frames have to be passed in order, the history is discarded if the resolution or camera type changes.
+	class DLLRTUTIL TemporalDenoiser {
+	  public:
+		struct Settings {
+			uint32_t maxHistoryLength = 8;  // The history weight is at most maxHistoryLength / (maxHistoryLength + 1)
+			float depthTolerance = 0.05f;   // Relative
+			float normalThreshold = 0.9f;   // Minimum dot product between the current and the previous normal
+			bool clampHistory = true;
+		};
+		struct CameraInfo {
+			umath::ScaledTransform pose {};
+			umath::Degree fov = 39.6f; // Spans the larger image dimension
+			bool perspective = true;   // Only perspective cameras can be reprojected
+		};
+		// All images have to have the same resolution. The color image is denoised in place, the auxiliary images have to be
+		// float images and are optional, but either the position or the depth image is required for reprojection.
+		struct FrameInputs {
+			uimg::ImageBuffer *color = nullptr;
+			uimg::ImageBuffer *albedo = nullptr;
+			uimg::ImageBuffer *normal = nullptr;
+			uimg::ImageBuffer *position = nullptr;
+			uimg::ImageBuffer *depth = nullptr;
+		};
+		void SetSettings(const Settings &settings) { m_settings = settings; }
+		const Settings &GetSettings() const { return m_settings; }
+		bool Denoise(const Info &denoise, const CameraInfo &camera, const FrameInputs &inputs, const std::function<bool(float)> &fProgressCallback = nullptr);
+		// Discards the history, e.g. on a scene cut
+		void Reset();
+		bool HasHistory() const { return m_hasHistory; }
+	  private:
+		struct History {
+			std::vector<float> color;   // RGB
+			std::vector<float> depth;   // Planar depth, infinity for pixels without a valid position
+			std::vector<float> normals; // RGB, empty if there was no normal image
+			std::vector<uint8_t> length;
+			void Resize(size_t numPixels, bool normals);
+		};
+		Settings m_settings {};
+		History m_history {};
+		History m_nextHistory {};
+		CameraInfo m_historyCamera {};
+		uint32_t m_historyWidth = 0;
+		uint32_t m_historyHeight = 0;
+		bool m_hasHistory = false;
+		bool m_missingGeometryReported = false; // Only reported once per denoiser, i.e. once per image sequence
+		std::vector<Vector3> m_positions;
+		std::vector<float> m_currentColor;
+	};
+};
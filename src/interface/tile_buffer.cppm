@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:tile_buffer;
+
+export import std;
+
+export namespace pragma::scenekit {
+	// Hands out fixed-size slabs for tile pixel data and recycles them once they're no longer in use.
+	class DLLRTUTIL TileBufferPool : public std::enable_shared_from_this<TileBufferPool> {
+	  public:
+		static std::shared_ptr<TileBufferPool> Create(size_t slabSize);
+		~TileBufferPool();
+		size_t GetSlabSize() const { return m_slabSize; }
+		size_t GetIdleSlabCount() const;
+		// Frees all slabs that are currently not in use
+		void Clear();
+
+		// Returns a slab of at least the specified size. Requests that exceed the slab size are
+		// served from the heap and are not recycled.
+		std::shared_ptr<uint8_t[]> Acquire(size_t size);
+	  private:
+		TileBufferPool(size_t slabSize);
+		void Release(uint8_t *slab);
+		size_t m_slabSize = 0;
+		mutable std::mutex m_mutex;
+		std::vector<uint8_t *> m_idleSlabs;
+	};
+
+	// Reference-counted handle to tile pixel data. Copying a handle shares the pixel data instead of
+	// copying it, which means a buffer must not be modified once it has been shared (see MakeUnique).
+	// The lower-case methods mirror std::vector so existing code operating on tile data keeps working.
+	class DLLRTUTIL TileBuffer {
+	  public:
+		TileBuffer() = default;
+		TileBuffer(const std::shared_ptr<TileBufferPool> &pool);
+
+		uint8_t *data() { return m_data.get(); }
+		const uint8_t *data() const { return m_data.get(); }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		// Makes sure the buffer can hold the specified number of bytes and isn't shared with any other handle.
+		// The previous contents are preserved (up to the new size), new bytes are uninitialized.
+		void resize(size_t size);
+		void clear();
+
+		bool IsUnique() const { return m_data.use_count() <= 1; }
+		// Copies the data into a buffer owned exclusively by this handle, if it is currently shared
+		void MakeUnique();
+		const std::shared_ptr<TileBufferPool> &GetPool() const { return m_pool; }
+	  private:
+		std::shared_ptr<uint8_t[]> Allocate(size_t size) const;
+		std::shared_ptr<TileBufferPool> m_pool = nullptr;
+		std::shared_ptr<uint8_t[]> m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_capacity = 0;
+	};
+};
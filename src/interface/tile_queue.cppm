@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:tile_queue;
+
+export import std;
+
+export namespace pragma::scenekit {
+	enum class TileSchedulingPolicy : uint8_t {
+		Fifo = 0,         // Tiles are processed in the order they were queued in
+		CenterOut,        // Spiral from the center of the image towards the borders
+		Hilbert,          // Hilbert curve order, keeps consecutive tiles spatially coherent
+		RegionOfInterest, // Tiles inside the region of interest first (regardless of how often they've been processed), then by distance to the region
+	};
+	// Region in normalized tile grid coordinates [0,1]
+	struct DLLRTUTIL TileRegion {
+		float minX = 0.f;
+		float minY = 0.f;
+		float maxX = 1.f;
+		float maxY = 1.f;
+	};
+	// Priority queue of tile indices. Has the same interface as std::queue, but pops tiles according to the scheduling policy.
+	// Every tile is queued at most once, tiles that have been processed fewer times take precedence over tiles that have been processed
+	// more often, so no part of the image can starve. The exception are tiles inside the region of interest, which always take
+	// precedence with TileSchedulingPolicy::RegionOfInterest. Not thread-safe.
+	class DLLRTUTIL TileQueue {
+	  public:
+		void Initialize(uint32_t numTilesX, uint32_t numTilesY);
+		void SetPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest = {});
+		TileSchedulingPolicy GetPolicy() const { return m_policy; }
+		// Lower rank means higher priority. Tiles outside of the grid have the lowest priority.
+		uint32_t GetRank(size_t tileIndex) const { return (tileIndex < m_ranks.size()) ? m_ranks[tileIndex] : std::numeric_limits<uint32_t>::max(); }
+
+		void push(size_t tileIndex);
+		void pop();
+		size_t front() const;
+		bool empty() const { return m_heap.empty(); }
+		size_t size() const { return m_heap.size(); }
+		void clear();
+	  private:
+		struct Entry {
+			uint32_t pass;
+			uint32_t rank;
+			uint64_t sequence;
+			size_t tileIndex;
+		};
+		static bool HasLowerPriority(const Entry &a, const Entry &b);
+		void UpdateRanks();
+		uint32_t GetPass(size_t tileIndex) const;
+		uint32_t m_numTilesX = 0;
+		uint32_t m_numTilesY = 0;
+		TileSchedulingPolicy m_policy = TileSchedulingPolicy::Fifo;
+		TileRegion m_regionOfInterest {};
+		std::vector<uint32_t> m_ranks;
+		std::vector<uint32_t> m_passes;
+		std::vector<bool> m_inRegion;
+		std::vector<bool> m_queued;
+		std::vector<Entry> m_heap;
+		uint64_t m_nextSequence = 0;
+	};
+};
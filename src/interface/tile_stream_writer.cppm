@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: (c) 2024 Silverlan <opensource@pragma-engine.com>
+// SPDX-License-Identifier: MIT
+
+module;
+
+#include "definitions.hpp"
+
+export module pragma.scenekit:tile_stream_writer;
+
+export import std;
+export import :tile_buffer;
+export import pragma.image;
+
+export namespace pragma::scenekit {
+	// Writes tiles into a raw RGBA float image file on a background thread, so the full image never has to be held in memory.
+	// File layout: TileStreamWriter::Header, followed by width * height RGBA float pixels in row-major order, top row first.
+	// Tiles are queued in a bounded write-behind buffer. If a tile is queued again before it has been written, only the newest
+	// sample is kept. If the buffer is full, Write blocks until the writer has caught up.
+	class DLLRTUTIL TileStreamWriter {
+	  public:
+		struct Header {
+			std::array<char, 8> magic {'S', 'K', 'T', 'I', 'L', 'E', 'S', '\0'};
+			uint32_t version = 1;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t numChannels = 4;
+			uint32_t bytesPerChannel = sizeof(float);
+			uint32_t reserved = 0;
+		};
+		struct Tile {
+			uint32_t key = 0; // Tiles with the same key are coalesced
+			uint16_t x = 0;
+			uint16_t y = 0;
+			uint16_t w = 0;
+			uint16_t h = 0;
+			uint16_t sample = 0;
+			TileBuffer data; // Tightly packed RGBA float rows
+		};
+		static std::unique_ptr<TileStreamWriter> Create(const std::string &fileName, uint32_t width, uint32_t height, uint32_t maxPendingTiles, std::string &outErr);
+		// Reads a complete file back into an RGBA float image
+		static std::shared_ptr<uimg::ImageBuffer> ReadImage(const std::string &fileName, std::string &outErr);
+		~TileStreamWriter();
+		void Write(Tile &&tile);
+		// Same as Write, but returns false instead of blocking if the buffer is full, in which case the tile is left untouched
+		bool TryWrite(Tile &tile);
+		// Blocks until all queued tiles have been written to the file
+		void Flush();
+		// Flushes the remaining tiles and closes the file. Returns false if an error has occurred at any point.
+		bool Close();
+		bool HasError() const;
+		std::string GetError() const;
+		const std::string &GetFileName() const { return m_fileName; }
+		size_t GetPendingTileCount() const;
+		uint64_t GetWrittenTileCount() const { return m_numWrittenTiles; }
+	  private:
+		TileStreamWriter(const std::string &fileName, uint32_t width, uint32_t height, uint32_t maxPendingTiles);
+		// Has to be called with the mutex locked, returns false if the tile has to wait for space in the buffer
+		bool Enqueue(Tile &tile, bool &outQueued);
+		void Run();
+		bool WriteTile(const Tile &tile);
+		void SetError(const std::string &err);
+
+		std::string m_fileName;
+		std::fstream m_file;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint32_t m_maxPendingTiles = 0;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_pendingCondition;
+		std::condition_variable m_writtenCondition;
+		std::deque<Tile> m_pendingTiles;
+		bool m_writing = false;
+		bool m_closing = false;
+		std::string m_error;
+		std::atomic<uint64_t> m_numWrittenTiles = 0;
+		std::thread m_thread;
+	};
+};
@@ -11,6 +11,11 @@ export module pragma.scenekit:tile_manager;
 import pragma.ocio;
 
 import :constants;
+export import :tile_buffer;
+export import :tile_queue;
+export import :tile_stream_writer;
+export import :preview_pyramid;
+export import :latency_histogram;
 
 export namespace pragma::scenekit {
 	enum class ColorTransform : uint8_t;
@@ -25,20 +30,80 @@ export namespace pragma::scenekit {
 			uint16_t sample = std::numeric_limits<uint16_t>::max();
 			uint16_t index = std::numeric_limits<uint16_t>::max();
 			Flags flags = Flags::None;
-			std::vector<uint8_t> data;
+			uint64_t timestamp = 0; // Only used for instrumentation
+			TileBuffer data;
 			bool IsFloatData() const;
 			bool IsHDRData() const;
 		};
+		// Writable view of a pooled tile buffer that a renderer can write samples to directly.
+		// The tile is published with CommitInputTile.
+		struct DLLRTUTIL TileLease {
+			TileData tile;
+			bool IsValid() const { return !tile.data.empty(); }
+			uint8_t *GetData() { return tile.data.data(); }
+			// Tile data is always RGBA float, with rows stored contiguously
+			static constexpr uint32_t GetPixelStride() { return sizeof(float) * 4; }
+			uint32_t GetRowStride() const { return tile.w * GetPixelStride(); }
+		};
+		struct DLLRTUTIL RenderedTileStats {
+			uint64_t numPublished = 0;
+			uint64_t numCoalesced = 0; // Tiles that superseded an older sample of the same tile before it was consumed
+			uint64_t numDropped = 0;   // Tiles that were discarded because the ring was full
+		};
 		struct ThreadData {};
 		enum class State : uint8_t { Initial = 0, Running, Cancelled, Stopped };
+		enum class PipelineStage : uint8_t {
+			QueueWait = 0,         // Time between a tile being queued (CommitInputTile or NotifyPendingWork) and a worker picking it up
+			Ingest,                // InitializeTileData
+			ColorTransform,        // ApplyPostProcessingForProgressiveTile
+			CompletedTileLockWait, // Time spent waiting for the completed tile lock
+			RenderedTileLockWait,  // Time spent waiting for the rendered tile lock
+			ConsumerDelay,         // Time between a rendered tile being published and being polled
+
+			Count
+		};
 		~TileManager();
 		void Initialize(uint32_t w, uint32_t h, uint32_t wTile, uint32_t hTile, bool cpuDevice, float exposure = 0.f, float gamma = DEFAULT_GAMMA, pragma::ocio::ColorProcessor *optColorProcessor = nullptr);
 		void Reload(bool waitForCompletion);
 		void Cancel();
 		void Wait();
 		void StopAndWait();
+		// Stops all workers and copies all tiles that have changed since the last call into the final image.
+		// In streaming mode the streaming output is flushed and the final image is read back from it. Returns nullptr if that fails.
 		std::shared_ptr<uimg::ImageBuffer> UpdateFinalImage();
+		// Returns a consistent copy of the final image in its current state without stopping the workers.
+		// The returned image must be treated as read-only and remains valid for as long as it's referenced.
+		// Not available in streaming mode.
+		std::shared_ptr<uimg::ImageBuffer> GetFinalImageSnapshot();
+
+		// Number of downscaled preview levels to maintain alongside the progressive image (see PreviewPyramid). Has to be set before Initialize.
+		void SetPreviewLevelCount(uint32_t numLevels) { m_numPreviewLevels = numLevels; }
+		uint32_t GetPreviewLevelCount() const { return m_previewPyramid.GetLevelCount(); }
+		// Returns the smallest preview level that is at least as large as the specified size, or 0 if there is none
+		uint32_t FindPreviewLevel(uint32_t width, uint32_t height) const { return m_previewPyramid.FindLevel(width, height); }
+		// Returns a copy of the specified preview level (starting at 1)
+		std::shared_ptr<uimg::ImageBuffer> GetPreviewLevel(uint32_t level) const { return m_previewPyramid.GetLevel(level); }
+
+		// If a file name is set, completed tiles are streamed into a raw image file (see TileStreamWriter) instead of being kept in memory,
+		// so memory usage depends on the number of tiles in flight instead of the resolution. Has to be set before Initialize.
+		// An empty file name disables streaming.
+		void SetStreamingOutput(const std::string &fileName, uint32_t maxPendingTiles = 32);
+		bool IsStreamingOutputEnabled() const { return m_streamWriter != nullptr; }
+		TileStreamWriter *GetStreamingOutput() { return m_streamWriter.get(); }
+		// Stops all workers, writes all remaining tiles and closes the file. Called by the renderer when rendering is complete.
+		bool FinalizeStreamingOutput();
+		// Returns all rendered tiles that have been published since the last call, with at most one (the newest) sample per tile.
+		// The returned tiles remain valid until the next call or until ReleaseRenderedTiles is called. Does not allocate.
+		// Only one consumer thread may call this.
+		const std::vector<TileData> &PollRenderedTiles();
+		void ReleaseRenderedTiles();
+		// Same as PollRenderedTiles, but moves the tiles into a new container
 		std::vector<TileData> GetRenderedTileBatch();
+		// Maximum number of unconsumed tiles before the oldest ones are dropped (defaults to the tile count). Can be set before
+		// Initialize, the capacity is limited to the tile count. Tiles without a valid tile index are never dropped.
+		void SetRenderedTileCapacity(uint32_t capacity);
+		RenderedTileStats GetRenderedTileStats() const;
+		void ResetRenderedTileStats();
 		void AddRenderedTile(TileData &&tile);
 		Vector2i GetTileSize() const { return m_tileSize; }
 		uint32_t GetTileCount() const { return m_numTiles; }
@@ -52,20 +117,77 @@ export namespace pragma::scenekit {
 		void SetFlipImage(bool flipHorizontally, bool flipVertically);
 		void SetExposure(float exposure);
 		void SetGamma(float gamma);
+		// If disabled, progressive tiles and preview snapshots are kept in half precision (RGBA_HDR).
+		// Completed tiles and the final image always use full precision.
 		void SetUseFloatData(bool b);
 
+		// A tile is considered converged once its estimated relative noise level falls below the threshold and it has at least
+		// minSamples samples. The noise level is estimated from the difference between successive progressive samples of the tile.
+		// A threshold of 0 disables convergence tracking.
+		void SetConvergenceThreshold(float threshold, uint32_t minSamples = 0);
+		float GetConvergenceThreshold() const { return m_convergenceThreshold; }
+		// Renderers can poll this to stop sampling converged tiles
+		bool IsTileConverged(uint32_t tileIndex) const;
+		// Returns the estimated relative noise level of the tile, or infinity if there are not enough samples yet
+		float GetTileError(uint32_t tileIndex) const;
+		uint32_t GetConvergedTileCount() const;
+
+		// Latency instrumentation of the tile pipeline, disabled by default
+		void SetInstrumentationEnabled(bool enabled);
+		bool IsInstrumentationEnabled() const { return m_instrumentationEnabled; }
+		const LatencyHistogram &GetStageLatency(PipelineStage stage) const { return m_stageLatencies[umath::to_integral(stage)]; }
+		void ResetInstrumentation();
+
+		// Order in which queued tiles are post-processed and in which rendered tiles are returned by PollRenderedTiles.
+		// The region of interest is in normalized image coordinates and only used by TileSchedulingPolicy::RegionOfInterest.
+		void SetTileSchedulingPolicy(TileSchedulingPolicy policy, const TileRegion &regionOfInterest = {});
+		TileSchedulingPolicy GetTileSchedulingPolicy() const { return m_schedulingPolicy; }
+		const TileRegion &GetRegionOfInterest() const { return m_regionOfInterest; }
+
+		// Weight of this tile manager when sharing the PostProcessingPool with other tile managers
+		void SetWorkerWeight(float weight);
+		float GetWorkerWeight() const { return m_workerWeight; }
+
+		// Pool for tile buffers of the current tile size. Tile data is passed through the pipeline by handle
+		// and only copied if it has to be modified while it's still shared.
+		const std::shared_ptr<TileBufferPool> &GetTileBufferPool() const { return m_tileBufferPool; }
+
 		void ApplyPostProcessingForProgressiveTile(TileData &data);
 
-		// For internal use only
+		// Zero-copy alternative to writing to GetInputTiles() under GetInputTileMutex(): The renderer
+		// writes the sample directly into the leased buffer without holding any locks and commits it afterwards.
+		TileLease LeaseInputTile(uint16_t tileIndex, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t sample);
+		bool CommitInputTile(TileLease &&lease);
+
+		// For internal use only. Once a worker has taken a tile, its slot keeps a buffer of the same size with undefined contents
+		// and the sample is set to the maximum value, which marks the slot as consumed until the renderer writes the next sample.
 		std::vector<TileData> &GetInputTiles() { return m_inputTiles; }
 		std::mutex &GetInputTileMutex() { return m_inputTileMutex; }
+		// Tile indices pushed into this queue (under GetInputTileMutex) are moved into the scheduling queue by the workers,
+		// which decides the order they're processed in (see SetTileSchedulingPolicy)
 		std::queue<size_t> &GetInputTileQueue() { return m_inputTileQueue; }
 		void NotifyPendingWork();
 	  private:
-		void ApplyRectData(const TileData &data);
+		// Has to be called with the input tile mutex locked
+		void DrainInputTileQueue();
+		void WriteStreamTile(TileStreamWriter::Tile &&tile);
+		// Blocks until all deferred tiles have been handed to the writer, workers must not be running
+		void FlushDeferredStreamTiles();
+		void ApplyRectData(const TileData &data, uimg::ImageBuffer &imgBuf);
+		void MarkTileDirty(size_t tileIndex);
+		void PublishRenderedTile(TileData &&tile);
+		void ClearPendingRenderedTiles();
+		void UpdateTileSchedulingPolicy();
+		void UpdateTileErrorEstimate(const TileData &prevTile, const TileData &tile);
+		uint64_t GetInstrumentationTimestamp() const;
+		void RecordStageLatency(PipelineStage stage, uint64_t startTimestamp);
 		void InitializeTileData(TileData &data);
+		bool ProcessInputTile(size_t tileIndex, TileData &tile);
+		bool TryScheduleWorker();
+		void RunWorker();
 		void SetState(State state);
 
+		Vector2i m_imageSize;
 		Vector2i m_tileSize;
 		uint32_t m_numTiles = 0;
 		Vector2i m_numTilesPerAxis;
@@ -75,27 +197,73 @@ export namespace pragma::scenekit {
 		float m_gamma = DEFAULT_GAMMA;
 
 		std::shared_ptr<pragma::ocio::ColorProcessor> m_colorTransformProcessor = nullptr;
+		std::shared_ptr<TileBufferPool> m_tileBufferPool = nullptr;
 
 		bool m_useFloatData = false;
 		bool m_cpuDevice = false;
-		std::atomic<bool> m_hasPendingWork = false;
 		std::mutex m_inputTileMutex;
 		std::vector<TileData> m_inputTiles; // Tiles that have been updated by Cycles, but still require post-processing
 		std::queue<size_t> m_inputTileQueue;
+		TileQueue m_scheduledTileQueue;
+		TileSchedulingPolicy m_schedulingPolicy = TileSchedulingPolicy::Fifo;
+		TileRegion m_regionOfInterest {};
 		bool m_flipHorizontally = false;
 		bool m_flipVertically = false;
 
 		std::mutex m_renderedTileMutex;
-		std::vector<TileData> m_renderedTiles;
-		std::array<std::future<void>, 10> m_ppThreadPoolHandles;
-		ctpl::thread_pool m_ppThreadPool {static_cast<int32_t>(m_ppThreadPoolHandles.size())};
-		std::condition_variable m_threadWaitCondition {};
-		std::mutex m_threadWaitMutex {};
+		// Bounded ring of tiles waiting to be consumed. Every tile has a single slot, which is overwritten
+		// by newer samples of the tile.
+		std::vector<TileData> m_renderedTileSlots;
+		std::vector<bool> m_renderedTileSlotPending;
+		std::vector<uint32_t> m_renderedTileRing;
+		uint32_t m_renderedTileRingHead = 0;
+		uint32_t m_renderedTileRingSize = 0;
+		uint32_t m_requestedRenderedTileCapacity = 0; // 0 = tile count
+		// Tiles without a valid tile index (e.g. from AddRenderedTile) don't have a slot and are passed on as they are
+		std::vector<TileData> m_unindexedRenderedTiles;
+		std::vector<TileData> m_consumedRenderedTiles;
+		std::atomic<uint64_t> m_numPublishedRenderedTiles = 0;
+		std::atomic<uint64_t> m_numCoalescedRenderedTiles = 0;
+		std::atomic<uint64_t> m_numDroppedRenderedTiles = 0;
+		float m_workerWeight = 1.f;
+		std::atomic<uint32_t> m_numActiveWorkers = 0;
 		std::atomic<State> m_state = State::Initial;
 
+		struct TileVarianceEstimate {
+			double varianceSum = 0.0; // Weighted sum of per-sample variance estimates
+			double weight = 0.0;
+		};
+		std::vector<TileVarianceEstimate> m_tileVarianceEstimates; // Guarded by m_completedTileMutex
+		std::vector<std::atomic<float>> m_tileErrors; // Sized in Initialize and only reset in place afterwards, workers access them without a lock
+		std::vector<std::atomic<uint32_t>> m_tileErrorSampleCounts;
+		std::atomic<float> m_convergenceThreshold = 0.f;
+		std::atomic<uint32_t> m_convergenceMinSamples = 0;
+
+		std::atomic<bool> m_instrumentationEnabled = false;
+		std::array<LatencyHistogram, umath::to_integral(PipelineStage::Count)> m_stageLatencies;
+
+		uint32_t m_numPreviewLevels = 0;
+		PreviewPyramid m_previewPyramid;
+
+		std::mutex m_deferredStreamTileMutex;
+		std::unordered_map<uint32_t, TileStreamWriter::Tile> m_deferredStreamTiles;
+		std::string m_streamFileName;
+		uint32_t m_streamMaxPendingTiles = 32;
+		std::unique_ptr<TileStreamWriter> m_streamWriter = nullptr;
+
 		std::mutex m_completedTileMutex;
 		std::vector<TileData> m_completedTiles;
+		std::vector<bool> m_dirtyTiles; // Tiles that have changed since the last UpdateFinalImage call
 		std::shared_ptr<uimg::ImageBuffer> m_progressiveImage = nullptr;
+
+		struct SnapshotBuffer {
+			std::shared_ptr<uimg::ImageBuffer> image;
+			std::vector<bool> dirtyTiles;
+		};
+		std::mutex m_snapshotMutex;
+		std::array<SnapshotBuffer, 2> m_snapshotBuffers;
+		uint32_t m_frontSnapshotBuffer = 0;
+		std::vector<TileData> m_snapshotTiles;
 	};
 	using namespace umath::scoped_enum::bitwise;
 };
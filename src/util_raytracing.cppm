@@ -8,15 +8,27 @@ export import :constants;
 export import :data_value;
 export import :denoise;
 export import :exception;
+export import :image_buffer_pool;
+export import :image_dump_writer;
+export import :image_kernels;
+export import :latency_histogram;
 export import :light;
+export import :lightmap_atlas;
 export import :mesh;
 export import :model_cache;
 export import :object;
+export import :post_processing_pool;
+export import :preview_denoiser;
+export import :preview_pyramid;
 export import :renderer;
 export import :scene;
 export import :scene_object;
 export import :shader;
 export import :shader_nodes;
 export import :subdivision;
+export import :temporal_denoiser;
+export import :tile_buffer;
 export import :tile_manager;
+export import :tile_queue;
+export import :tile_stream_writer;
 export import :world_object;